@@ -0,0 +1,184 @@
+#include <bit>
+
+#include "bitboard.hpp"
+
+BitBoard::BitBoard(int width, int height)
+{
+    reset(width, height);
+}
+
+void BitBoard::reset(int width, int height)
+{
+    m_width = width;
+    m_height = height;
+    m_words = (width + word_bits - 1) / word_bits;
+    m_cat_i = m_cat_j = -1;
+
+    const int tail = width % word_bits;
+    m_last_mask = tail ? (Word(1) << tail) - 1 : ~Word(0);
+
+    const auto size = Rows::size_type(m_words) * height;
+    m_walls.assign(size, 0);
+    m_finals.assign(size, 0);
+    m_cat.assign(size, 0);
+    m_reach.assign(size, 0);
+    m_next.assign(size, 0);
+    m_zero.assign(m_words, 0);
+}
+
+void BitBoard::assign(int width, int height, const Word* walls, const Word* finals)
+{
+    reset(width, height);
+    m_walls.assign(walls, walls + m_walls.size());
+    m_finals.assign(finals, finals + m_finals.size());
+}
+
+void BitBoard::setCat(int i, int j)
+{
+    if (m_cat_i >= 0)
+        clear(m_cat, m_cat_i, m_cat_j);
+
+    m_cat_i = i;
+    m_cat_j = j;
+    set(m_cat, i, j);
+}
+
+void BitBoard::expandRow(const Rows& from, int i, Word* out) const
+{
+    const Word* row = &from[i * m_words];
+    const Word* below = i > 0 ? row - m_words : m_zero.data();
+    const Word* above = i + 1 < m_height ? row + m_words : m_zero.data();
+    const Word* walls = &m_walls[i * m_words];
+
+    // Rows i-1 and i+1 share a parity: even rows reach columns j and j+1 of
+    // row i, odd rows reach j-1 and j
+    const bool from_odd = not (i & 1);
+    const int high = word_bits - 1;
+
+    Word prev_row = 0, prev_near = 0;
+    Word cur_row = row[0], cur_near = below[0] | above[0];
+    for (int w = 0; w < m_words; ++w) {
+        const bool last = w + 1 == m_words;
+        const Word next_row = last ? 0 : row[w + 1];
+        const Word next_near = last ? 0 : below[w + 1] | above[w + 1];
+
+        Word acc = cur_row | (cur_row << 1 | prev_row >> high) | (cur_row >> 1 | next_row << high) | cur_near;
+        acc |= from_odd ? (cur_near >> 1 | next_near << high) : (cur_near << 1 | prev_near >> high);
+
+        acc &= ~walls[w];
+        if (last)
+            acc &= m_last_mask;
+        out[w] = acc;
+
+        prev_row = cur_row;
+        prev_near = cur_near;
+        cur_row = next_row;
+        cur_near = next_near;
+    }
+}
+
+void BitBoard::expand(const Rows& from, Rows& to) const
+{
+    to.resize(from.size());
+
+    for (int i = 0; i < m_height; ++i)
+        expandRow(from, i, &to[i * m_words]);
+}
+
+int BitBoard::escapeDistance() const
+{
+    m_reach = m_cat;
+
+    for (int distance = 0;; ++distance) {
+        for (Rows::size_type k = 0; k < m_reach.size(); ++k)
+            if (m_reach[k] & m_finals[k])
+                return distance;
+
+        expand(m_reach, m_next);
+        if (m_next == m_reach)
+            return -1;
+        m_reach.swap(m_next);
+    }
+}
+
+int BitBoard::catWay(std::vector<int>& way, int max_length) const
+{
+    way.clear();
+    if (m_cat_i < 0)
+        return -1;
+
+    if (m_layers.empty())
+        m_layers.emplace_back();
+
+    Rows& border = m_layers[0];
+    border.resize(m_finals.size());
+    for (Rows::size_type k = 0; k < border.size(); ++k)
+        border[k] = m_finals[k] & ~m_walls[k];
+
+    // m_layers[d] holds every free tile at most d steps from a final one
+    int distance = 0;
+    while (not test(m_layers[distance], m_cat_i, m_cat_j)) {
+        if (int(m_layers.size()) == distance + 1)
+            m_layers.emplace_back();
+
+        expand(m_layers[distance], m_layers[distance + 1]);
+        if (m_layers[distance + 1] == m_layers[distance])
+            return -1;
+        ++distance;
+    }
+
+    int i = m_cat_i, j = m_cat_j;
+    for (int layer = distance - 1; layer >= 0 and int(way.size()) < max_length; --layer) {
+        const int neighbors[6][2] = {
+            {i+1, j - (i&1)}, {i+1, j+1 - (i&1)},
+            {i, j-1}, {i, j+1},
+            {i-1, j - (i&1)}, {i-1, j+1 - (i&1)}
+        };
+
+        for (auto &n : neighbors)
+            if (n[0] >= 0 and n[0] < m_height and n[1] >= 0 and n[1] < m_width and
+                test(m_layers[layer], n[0], n[1])) {
+                i = n[0];
+                j = n[1];
+                break;
+            }
+
+        way.push_back(i * m_width + j);
+    }
+    return distance;
+}
+
+void BitBoard::borderDistances(std::vector<int>& distance, int unreachable) const
+{
+    distance.assign(std::vector<int>::size_type(m_width) * m_height, unreachable);
+
+    // Write the distance of the fresh tiles of a word
+    auto mark = [&](Rows::size_type k, Word fresh, int d) {
+        const int base = int(k / m_words) * m_width + int(k % m_words) * word_bits;
+        for (; fresh; fresh &= fresh - 1)
+            distance[base + std::countr_zero(fresh)] = d;
+    };
+
+    for (Rows::size_type k = 0; k < m_reach.size(); ++k) {
+        m_reach[k] = m_finals[k] & ~m_walls[k];
+        mark(k, m_reach[k], 0);
+    }
+
+    for (int d = 1;; ++d) {
+        bool grown = false;
+        for (int i = 0; i < m_height; ++i) {
+            Word* out = &m_next[i * m_words];
+            expandRow(m_reach, i, out);
+
+            for (int w = 0; w < m_words; ++w)
+                if (Word fresh = out[w] & ~m_reach[i * m_words + w]) {
+                    mark(i * m_words + w, fresh, d);
+                    grown = true;
+                }
+        }
+
+        if (not grown)
+            break;
+        m_reach.swap(m_next);
+    }
+}
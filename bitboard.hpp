@@ -0,0 +1,81 @@
+#ifndef BITBOARD_HPP
+#define BITBOARD_HPP
+
+#include <cstdint>
+#include <vector>
+
+// Packed bit rows of a board: bit j of row i is the tile (i, j). Rows wider
+// than one word take several consecutive words, low columns first.
+//
+// Reachability expands whole rows at once. Neighbours follow the table of
+// Map::findShortestWay: even rows touch columns j and j+1 of the rows above
+// and below, odd rows touch columns j-1 and j.
+class BitBoard {
+public:
+    using Word = std::uint64_t;
+    using Rows = std::vector<Word>;
+
+    static constexpr int word_bits = 64;
+
+    BitBoard() = default;
+    BitBoard(int width, int height);
+
+    // Empty board of the given size, keeping the storage
+    void reset(int width, int height);
+    // Board of the given size with rows copied from walls() and finals() of another
+    void assign(int width, int height, const Word* walls, const Word* finals);
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    int words() const { return m_words; }
+
+    void setWall(int i, int j) { set(m_walls, i, j); }
+    void clearWall(int i, int j) { clear(m_walls, i, j); }
+    void setFinal(int i, int j) { set(m_finals, i, j); }
+    void setCat(int i, int j);
+
+    bool wall(int i, int j) const { return test(m_walls, i, j); }
+    bool final(int i, int j) const { return test(m_finals, i, j); }
+
+    const Rows& walls() const { return m_walls; }
+    const Rows& finals() const { return m_finals; }
+    const Rows& cat() const { return m_cat; }
+
+    // Grow `from` by one step into every free neighbour
+    void expand(const Rows& from, Rows& to) const;
+
+    // Number of steps from the cat to the nearest final tile, -1 if the cat is enclosed
+    int escapeDistance() const;
+    bool canEscape() const { return escapeDistance() >= 0; }
+
+    // Same distance, found by growing layers from the final tiles, plus the
+    // cat's way out (flat i * width + j indices, first step first) picked by
+    // the rule of Map::turn: the first neighbour one step closer.
+    int catWay(std::vector<int>& way, int max_length) const;
+
+    // Distance of every tile to the nearest final one, row-major, one layer
+    // per step; walls and enclosed tiles get `unreachable`
+    void borderDistances(std::vector<int>& distance, int unreachable) const;
+
+private:
+    int m_width = 0, m_height = 0, m_words = 0;
+    Word m_last_mask = 0; // Valid columns of the last word of a row
+
+    Rows m_walls;
+    Rows m_finals;
+    Rows m_cat;
+    int m_cat_i = -1, m_cat_j = -1;
+
+    mutable Rows m_reach;
+    mutable Rows m_next;
+    mutable std::vector<Rows> m_layers;
+    Rows m_zero; // One row of zeros, beyond the top and bottom rows
+
+    void expandRow(const Rows& from, int i, Word* out) const;
+
+    void set(Rows& rows, int i, int j) { rows[i * m_words + j / word_bits] |= Word(1) << (j % word_bits); }
+    void clear(Rows& rows, int i, int j) { rows[i * m_words + j / word_bits] &= ~(Word(1) << (j % word_bits)); }
+    bool test(const Rows& rows, int i, int j) const { return rows[i * m_words + j / word_bits] >> (j % word_bits) & 1; }
+};
+
+#endif // BITBOARD_HPP
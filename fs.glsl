@@ -2,22 +2,34 @@
 
 out vec4 color;
 
-uniform bool Selected;
-uniform vec3 Color;
+// HexType and Option of the tile
+flat in uint Type;
+flat in uint Options;
+
+uniform vec3 RegularColor;
+uniform vec3 WallColor;
+uniform vec3 ProhibitedColor;
+uniform vec3 WayColor;
 
 uniform sampler2D Texture;
 in vec2 TexCoord;
-uniform bool TextureEnabled = false;
 uniform float DisappearingTexture = 1.0f;
 
 void main()
 {
-    if (TextureEnabled)
-	color = mix(vec4(Color, 1.0f), texture2D(Texture, TexCoord), DisappearingTexture);
+    vec3 base = RegularColor;
+    if (Type == 1u)
+	base = WallColor;
+    else if (Type == 0u && (Options & 8u) != 0u)
+	base = ProhibitedColor;
+    else if (Type == 0u && (Options & 4u) != 0u)
+	base = WayColor;
+
+    if (Type == 2u)
+	color = mix(vec4(base, 1.0f), texture(Texture, TexCoord), DisappearingTexture);
     else
-	color = vec4(Color, 1.0f);
+	color = vec4(base, 1.0f);
 
-    if (Selected)
+    if ((Options & 1u) != 0u)
 	color -= 0.2f;
-
 }
@@ -0,0 +1,61 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+
+#include "rng.hpp"
+#include "generator.hpp"
+
+// Boards handed to a thread at a time
+#define GENERATION_BATCH 256
+
+std::uint64_t boardSeed(std::uint64_t stream, std::uint64_t n)
+{
+    std::uint64_t state = stream ^ (n * 0xd1b54a32d192ed03ull);
+    return splitmix64(state);
+}
+
+void generateBoards(std::vector<Map>& maps, std::size_t count,
+                    std::uint64_t stream, std::uint64_t first, const MapSettings& settings,
+                    unsigned threads)
+{
+    if (count == 0) {
+        maps.clear();
+        return;
+    }
+
+    // Grow with copies of the first board, which is drawn again below anyway
+    if (maps.size() < count)
+        maps.resize(count, Map(boardSeed(stream, first), settings));
+    else
+        maps.erase(maps.begin() + count, maps.end());
+
+    std::atomic<std::size_t> next{0};
+    std::exception_ptr error; // The first board that could not be drawn
+    std::mutex error_lock;
+    auto work = [&]() {
+        try {
+            for (std::size_t begin; (begin = next.fetch_add(GENERATION_BATCH)) < count;) {
+                const std::size_t end = std::min(count, begin + GENERATION_BATCH);
+                for (std::size_t k = begin; k < end; ++k)
+                    maps[k].generate(boardSeed(stream, first + k), settings);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(error_lock);
+            if (not error)
+                error = std::current_exception();
+            next.store(count); // The other threads stop at their next batch
+        }
+    };
+
+    threads = std::max(1u, std::min<unsigned>(threads, unsigned((count + GENERATION_BATCH - 1) / GENERATION_BATCH)));
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+        pool.emplace_back(work);
+    work();
+    for (auto &t : pool)
+        t.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
@@ -0,0 +1,21 @@
+#ifndef GENERATOR_HPP
+#define GENERATOR_HPP
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "map.hpp"
+
+// Reproducible board streams: board n of a stream depends only on the
+// stream seed and n, so batches can be split over threads in any order.
+std::uint64_t boardSeed(std::uint64_t stream, std::uint64_t n);
+
+// Fills `maps` with boards first .. first + count - 1 of the stream. Maps
+// already in the vector are drawn again in place, keeping their storage.
+// What Map::generate throws on any thread is thrown here once all are done.
+void generateBoards(std::vector<Map>& maps, std::size_t count,
+                    std::uint64_t stream, std::uint64_t first, const MapSettings& settings,
+                    unsigned threads = std::thread::hardware_concurrency());
+
+#endif // GENERATOR_HPP
@@ -0,0 +1,62 @@
+#include "profiler.hpp"
+#include "gpu_timer.hpp"
+
+GpuTimer::GpuTimer(int queries) : m_queries(queries)
+{
+    for (auto &q : m_queries)
+        glGenQueries(1, &q.id);
+}
+
+GpuTimer::~GpuTimer()
+{
+    for (auto &q : m_queries)
+        glDeleteQueries(1, &q.id);
+}
+
+void GpuTimer::begin(const char *name)
+{
+    if (m_active >= 0 or not profiler::enabled())
+        return;
+
+    for (int k = 0; k < int(m_queries.size()); ++k) {
+        Query &q = m_queries[k];
+        if (q.pending)
+            continue;
+
+        q.name = name;
+        q.begin = profiler::now();
+        glBeginQuery(GL_TIME_ELAPSED, q.id);
+        m_active = k;
+        return;
+    }
+}
+
+void GpuTimer::end()
+{
+    if (m_active < 0)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    m_queries[m_active].pending = true;
+    m_active = -1;
+}
+
+void GpuTimer::collect()
+{
+    for (auto &q : m_queries) {
+        if (not q.pending)
+            continue;
+
+        GLint available = 0;
+        glGetQueryObjectiv(q.id, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (not available)
+            continue;
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(q.id, GL_QUERY_RESULT, &elapsed);
+        // Some drivers (llvmpipe) give back a timestamp for the first query
+        if (elapsed <= profiler::now() - q.begin)
+            profiler::record(q.name, q.begin, elapsed, profiler::gpu_track);
+        q.pending = false;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef GPU_TIMER_HPP
+#define GPU_TIMER_HPP
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <vector>
+
+// GL_TIME_ELAPSED spans recorded on the profiler's GPU track. Results are
+// read a few frames later, once available, so timing never stalls the
+// pipeline; a span is dropped when all queries are still in flight, or
+// when its result is longer than the time since it was submitted. GL
+// allows one such query at a time, so spans can't nest.
+class GpuTimer {
+public:
+    explicit GpuTimer(int queries = 16);
+    ~GpuTimer();
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    // Do nothing while the profiler is disabled
+    void begin(const char *name);
+    void end();
+
+    // Records the spans whose results have arrived
+    void collect();
+
+private:
+    struct Query {
+        GLuint id;
+        const char *name = nullptr;
+        std::uint64_t begin = 0; // CPU time of the submission
+        bool pending = false;
+    };
+
+    std::vector<Query> m_queries;
+    int m_active = -1;
+};
+
+#endif // GPU_TIMER_HPP
@@ -1,29 +1,48 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
-#include <SOIL/SOIL.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <future>
 #include <iostream>
+#include <optional>
+#include <string>
 #include <thread>
 
 #include "util.hpp"
-#include "Shader.h"
+#include "shader.hpp"
+#include "gpu_timer.hpp"
 #include "map.hpp"
+#include "profiler.hpp"
+#include "replay.hpp"
 #include "sound.hpp"
+#include "texture_cache.hpp"
+#include "tile_buffer.hpp"
 
 #define FLIP_TIME 1.0f
 #define DISAPPEARING_TIME 2.0f
+#define IDLE_WAIT_TIME 0.5 // Longest sleep between checks of the on-demand loop
 
-GLuint createTexture(const char *file_name);
+GLuint createTexture(const char *file_name, const TextureSource& source);
 void mouseCallback(GLFWwindow* window, int button, int action, int mods);
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode);
 void cursorCallback(GLFWwindow* window, double xpos, double ypos);
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void windowScale(GLFWwindow* window, int w, int h);
-void doFlip(glm::mat4& model, GLfloat degree);
+GLfloat flipAngle(GLfloat degree);
 void do_movement();
+void reportStatus(Status before);
+void restart();
+bool needsRedraw();
+void refreshCallback(GLFWwindow* window);
+void printProfile(std::uint64_t since);
+bool parseArguments(int argc, char **argv);
 
-float mouse_x_NDC(double x);
-float mouse_y_NDC(double y);
+Point cursorToBoard(double x, double y);
 
 GLfloat sin30 = 0.5f;
 
@@ -42,6 +61,14 @@ static Map game_map;
 GLfloat deltaTime = 0.0f;
 GLfloat lastFrame = 0.0f;
 
+bool on_demand = false;    // Redraw only on input, resize or animation (--redraw on-demand)
+double max_fps = 0.0;      // Frame-rate cap, 0 for none (--fps N)
+bool redraw_needed = true; // Set by the callbacks
+
+std::string trace_path;    // Profile into this trace, T writes it (--profile FILE)
+std::string music_path;    // Looped in the background (--music FILE)
+std::string audio_out;     // Mix in software into this WAV, no device (--audio-out FILE)
+
 GLfloat lastX = 400, lastY = 300;
 GLfloat yaw = -90.0f;
 GLfloat pitch = 0.0f;
@@ -49,17 +76,9 @@ GLfloat fov = 45.0f;
 
 GLuint WIDTH = 800, HEIGHT = 600;
 
-const GLfloat scale = 0.60f;
-const GLfloat edge = 0.30f;
-
-const GLfloat map_stride_x = 1.0f + 0.5f + edge + 0.5f;
-const GLfloat map_stride_y = 1.0f + 0.5f + edge;
-const GLfloat shift = 1.0f + edge / 2;
-
-const GLfloat x_width = game_map.width() * map_stride_x * scale;
-const GLfloat y_width = game_map.height() * map_stride_y * scale;
-const GLfloat x_offset = (2.0f - x_width) / 2 + -1.0f;
-const GLfloat y_offset = (2.0f - y_width) / 2 + -1.0f;
+MapSettings settings;
+replay::Writer recorder; // Open with --record
+BoardLayout layout(game_map.width(), game_map.height());
 
 glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, 3.0f);
 glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
@@ -73,21 +92,29 @@ const glm::vec3
         regular_color(0.0f, 1.0f, 1.0f),
         wall_color(1.0f, 0.5f, 0.0f);
 
+// The selected tile follows the cursor, like the hovered one follows the mouse
 class BoardNavigation {
     Position current;
-    const Map &map;
+    Map &map;
 
     void Validate(Position new_p) {
-        if (map.within(new_p))
+        if (map.within(new_p)) {
+            map.deselect(current);
             current = new_p;
+            map.select(current);
+        }
     }
 
 public:
-    BoardNavigation(const Map &m) : current{0, 0}, map(m) {}
+    BoardNavigation(Map &m) : current{0, 0}, map(m) {}
 
     Position getPosition() const
     { return current; }
 
+    // Marks the cursor on a new board
+    void Select()
+    { map.select(current); }
+
     void Up()
     { Validate(Position{current.i + 1, current.j}); }
 
@@ -141,33 +168,43 @@ public:
     void Unlock() {
         locked = false;
     }
-};
-
-class SourceWithLock {
-    Source m_source;
-    bool m_lock;
 
-public:
-    template <class... Args>
-    SourceWithLock(Args&& ...args) : m_source(std::forward<Args>(args)...), m_lock(false) {}
-    void lock() { m_lock = true; }
-    void unlock() { m_lock = false; }
-    void playAsync() {
-        if (not m_lock)
-            m_source.playAsync();
+    bool Locked() const {
+        return locked;
     }
 };
 
 Timer timer;
 
-SourceWithLock *source_with_lock_cat = nullptr;
-Source *source_wall = nullptr;
-Source *source_restart = nullptr;
+const Sound *sound_lose = nullptr;
+const Sound *sound_wall = nullptr;
+const Sound *sound_restart = nullptr;
 
 bool keys[1024];
 
-int main()
+int main(int argc, char **argv)
 {
+    if (not parseArguments(argc, argv))
+        return 1;
+
+    // Files are decoded on worker threads while the board, the window and
+    // the contexts come up; only the uploads wait for them
+    auto lose_wave = std::async(std::launch::async, Sound::decode, PATH_TO("lose.wav"));
+    auto wall_wave = std::async(std::launch::async, Sound::decode, PATH_TO("wall.wav"));
+    auto restart_wave = std::async(std::launch::async, Sound::decode, PATH_TO("restart.wav"));
+    auto vertex_code = std::async(std::launch::async, Program::readSource, PATH_TO("vs.glsl"));
+    auto fragment_code = std::async(std::launch::async, Program::readSource, PATH_TO("fs.glsl"));
+    auto cat_image = std::async(std::launch::async, readTexture, std::string(PATH_TO("cat.jpg")));
+
+    // The first board tells whether the density leaves a playable one
+    try {
+        restart();
+    } catch (std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+
+    const std::uint64_t launch = profiler::now();
     glfwInit();
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -186,33 +223,48 @@ int main()
     glfwSetCursorPosCallback(window, cursorCallback);
     glfwSetFramebufferSizeCallback(window, windowScale);
     glfwSetScrollCallback(window, scrollCallback);
+    glfwSetWindowRefreshCallback(window, refreshCallback);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     glViewport(0, 0, WIDTH, HEIGHT);
     glClearColor(0.9f, 0.9f, 0.9f, 1.0f);
 
-    SoundSystem& sound_system = SoundSystem::getInstance();
-    sound_system.init();
-
-    Sound lose_sound(PATH_TO("lose.wav"));
-    SourceWithLock source_with_lock_cat_itself(lose_sound, 0.0f, 0.0f, 0.0f);
-    source_with_lock_cat = &source_with_lock_cat_itself;
-
-    Sound wall_sound(PATH_TO("wall.wav"));
-    Source source_wall_itself(wall_sound, 0.0f, 0.0f, 0.0f);
-    source_wall = &source_wall_itself;
+    std::optional<profiler::Scope> loading(std::in_place, "load assets");
 
-    Sound restart_sound(PATH_TO("restart.wav"));
-    Source source_restart_itself(restart_sound, 0.0f, 0.0f, 0.0f);
-    source_restart = &source_restart_itself;
+    SoundSystem& sound_system = SoundSystem::getInstance();
+    if (audio_out.empty())
+        sound_system.init();
+    else
+        sound_system.initSoftware(audio_out);
+
+    // Quick wall clicks overlap, the end and restart cues cut through them
+    Sound lose_sound(lose_wave.get());
+    lose_sound.setMixing(2, 1);
+    sound_lose = &lose_sound;
+
+    Sound wall_sound(wall_wave.get());
+    wall_sound.setMixing(0, 4);
+    sound_wall = &wall_sound;
+
+    Sound restart_sound(restart_wave.get());
+    restart_sound.setMixing(1, 1);
+    sound_restart = &restart_sound;
+
+    // Streamed, so a long track neither delays the start nor sits in memory
+    std::optional<Stream> music;
+    if (not music_path.empty()) {
+        music.emplace(music_path.c_str(), true);
+        music->play();
+    }
 
 
 //    glEnable(GL_CULL_FACE);
 //    glCullFace(GL_FRONT);
 
-    Program hexagon_shader(PATH_TO("vs.glsl"), PATH_TO("fs.glsl"));        
+    Program hexagon_shader(vertex_code.get(), fragment_code.get(), PATH_TO("vs.glsl"));
 
-    GLuint cat_texture = createTexture(PATH_TO("cat.jpg"));
+    GLuint cat_texture = createTexture(PATH_TO("cat.jpg"), cat_image.get());
+    loading.reset();
 
     GLuint VBO, VAO;
     glGenBuffers(1, &VBO);
@@ -227,107 +279,152 @@ int main()
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    std::srand(std::time(nullptr)); // For map generation
+    // One instance per tile, only changed tiles are written
+    std::optional<TileBuffer> tile_buffer(std::in_place, VAO, 2, 3);
+    std::optional<GpuTimer> gpu_timer(std::in_place);
+    std::uint64_t profile_since = profiler::now();
+    std::uint64_t frame_count = 0;
+
+    hexagon_shader.setUniform("RegularColor", regular_color);
+    hexagon_shader.setUniform("WallColor", wall_color);
+    hexagon_shader.setUniform("ProhibitedColor", prohibited_color);
+#ifdef PATH_HIGHLIGHT
+    hexagon_shader.setUniform("WayColor", way_highlight_color);
+#endif
+
+    // Set every frame
+    const auto projection_uniform = hexagon_shader.uniform<glm::mat4>("projection");
+    const auto view_uniform = hexagon_shader.uniform<glm::mat4>("view");
+    const auto width_uniform = hexagon_shader.uniform<int>("Width");
+    const auto scale_uniform = hexagon_shader.uniform<float>("Scale");
+    const auto offset_uniform = hexagon_shader.uniform<glm::vec2>("Offset");
+    const auto stride_x_uniform = hexagon_shader.uniform<float>("StrideX");
+    const auto stride_y_uniform = hexagon_shader.uniform<float>("StrideY");
+    const auto shift_uniform = hexagon_shader.uniform<float>("Shift");
+    const auto cat_angle_uniform = hexagon_shader.uniform<float>("CatAngle");
+    const auto disappearing_uniform = hexagon_shader.uniform<float>("DisappearingTexture");
+
+#ifdef UNIFORM_STATS
+    GLfloat stats_since = glfwGetTime();
+    unsigned long stats_frames = 0;
+#endif
 
     while (!glfwWindowShouldClose(window)) {
+        if (on_demand and not needsRedraw()) {
+            glfwWaitEventsTimeout(IDLE_WAIT_TIME);
+            // The camera moves by the time between frames, not the time spent idle
+            lastFrame = glfwGetTime();
+            continue;
+        }
+        redraw_needed = false;
+
         GLfloat currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        glfwPollEvents();
-        do_movement();
-        glClear(GL_COLOR_BUFFER_BIT);
+        profiler::Scope frame_scope("frame");
 
-        hexagon_shader.use();
-        glBindVertexArray(VAO);
-        for (GLuint i = 0; i < game_map.height(); ++i)
-            for (GLuint j = 0; j< game_map.width(); ++j) {
+        {
+            profiler::Scope scope("poll events");
+            glfwPollEvents();
+            do_movement();
+        }
 
-                glm::mat4 model(1), view(1), projection(1);
-                auto &tile = game_map.at(i, j);
+        GLfloat cat_angle = 0.0f, disappearing = 1.0f;
+        if (game_map.status() == Status::win) {
+            cat_angle = flipAngle(360.0f);
+        } else if (game_map.status() == Status::fail) {
+            if (timer.Running()) {
+                disappearing = 1 - timer.GetTime()/DISAPPEARING_TIME;
+            } else if (timer.Locked()) {
+                disappearing = 0.0f;
+            } else {
+                timer.SetTime(DISAPPEARING_TIME);
+                timer.Start();
+                timer.Lock();
+                if (sound_lose)
+                    sound_lose->play();
+            }
+        }
 
-                view = lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+        {
+            profiler::Scope scope("uniforms");
+
+            glm::mat4 view = lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+            glm::mat4 projection = glm::perspective(glm::radians(fov), (GLfloat) WIDTH / (GLfloat)HEIGHT, 0.1f, 100.0f);
+
+            hexagon_shader.set(projection_uniform, projection);
+            hexagon_shader.set(view_uniform, view);
+            hexagon_shader.set(width_uniform, int(game_map.width()));
+            hexagon_shader.set(scale_uniform, layout.scale);
+            hexagon_shader.set(offset_uniform, glm::vec2(layout.x_offset, layout.y_offset));
+            hexagon_shader.set(stride_x_uniform, layout.stride_x);
+            hexagon_shader.set(stride_y_uniform, layout.stride_y);
+            hexagon_shader.set(shift_uniform, layout.shift);
+            hexagon_shader.set(cat_angle_uniform, glm::radians(cat_angle));
+            hexagon_shader.set(disappearing_uniform, disappearing);
+        }
 
-                projection = glm::perspective(glm::radians(fov), (GLfloat) WIDTH / (GLfloat)HEIGHT, 0.1f, 100.0f);
+        const GLsizei tiles = GLsizei(game_map.width() * game_map.height());
 
-                model = glm::translate(model, glm::vec3(x_offset, y_offset, 0.0f));
-                model = glm::scale(model, glm::vec3(scale, scale, scale));
-                model = glm::translate(model, glm::vec3(j * map_stride_x + shift * !(i & 1), i * map_stride_y, 0.0f));
+        {
+            profiler::Scope scope("upload tiles");
+            gpu_timer->begin("upload tiles (GPU)");
+            tile_buffer->update(game_map);
+            gpu_timer->end();
+        }
 
-#ifndef KEYBOARD_CONTROL
-                // Assign appropriate coordinates
-                for (int i = 0; i < 6; ++i) {
-                    auto&& vec = projection * view * model * glm::vec4(hexagon[0 + i*5], hexagon[1 + i*5], hexagon[2 + i*5], 1.0f);
-                    tile.v[i].x = vec.x;
-                    tile.v[i].y = vec.y;
-
-                    current = vec;
-                }
-#endif
-#ifdef KEYBOARD_CONTROL
-                auto curr = board_navigation.getPosition();
-                game_map.select(curr);
-#endif
+        {
+            profiler::Scope scope("draw");
+            gpu_timer->begin("draw (GPU)");
+            glClear(GL_COLOR_BUFFER_BIT);
+            hexagon_shader.use();
+            glBindVertexArray(VAO);
+            glBindTexture(GL_TEXTURE_2D, cat_texture);
+            glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 6, tiles);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            tile_buffer->fence();
+            glBindVertexArray(0);
+            gpu_timer->end();
+        }
 
-                hexagon_shader.setUniform("Selected", bool(tile.opt & Option::selected));
-                if (tile.type == HexType::regular) {
+        {
+            profiler::Scope scope("swap buffers");
+            glfwSwapBuffers(window);
+        }
+        if (profiler::enabled() and frame_count++ == 0)
+            std::cout << "first frame: " << double(profiler::now() - launch) / 1e6 << " ms after start" << std::endl;
+        gpu_timer->collect();
 
-                    if (tile.opt & Option::prohibited)
-                        hexagon_shader.setUniform("Color", prohibited_color);
-#ifdef PATH_HIGHLIGHT
-                    else if (tile.opt & Option::way_higlight)
-                        hexagon_shader.setUniform("Color", way_highlight_color);
+        if (profiler::enabled() and profiler::now() - profile_since >= 1000000000ull) {
+            printProfile(profile_since);
+            profile_since = profiler::now();
+        }
 
-#endif
-                    else
-                        hexagon_shader.setUniform("Color", regular_color);
-
-                } else if (tile.type == HexType::wall) {
-                    hexagon_shader.setUniform("Color", wall_color);
-                } else if (tile.type == HexType::cat) {
-
-                    if (game_map.status() == Status::win) {
-                        doFlip(model, 360.0f);
-                    } else if (game_map.status() == Status::fail) {
-                        hexagon_shader.setUniform("Color", regular_color);
-                        if (timer.Running()) {
-                            hexagon_shader.setUniform("DisappearingTexture", (1 - timer.GetTime()/DISAPPEARING_TIME));
-                        } else {
-                            timer.SetTime(DISAPPEARING_TIME);
-                            timer.Start();                           
-                            timer.Lock();
-                            if (source_with_lock_cat) {
-                                source_with_lock_cat->playAsync();
-                                source_with_lock_cat->lock();
-                            }
-
-                        }
-                    } else if (game_map.status() == Status::playing) {
-                        hexagon_shader.setUniform("DisappearingTexture", 1.0f);
-                    }
-
-                    hexagon_shader.setUniform("TextureEnabled", true);
-                    glBindTexture(GL_TEXTURE_2D, cat_texture);
-                }
-
-                hexagon_shader.setUniform("projection", projection);
-                hexagon_shader.setUniform("view", view);
-                hexagon_shader.setUniform("model", model);
-                glDrawArrays(GL_TRIANGLE_FAN, 0, 6);
-                glBindTexture(GL_TEXTURE_2D, 0);
-
-                hexagon_shader.setUniform("TextureEnabled", false);
-                hexagon_shader.setUniform("Selected", false);
-#ifdef KEYBOARD_CONTROL
-                game_map.deselect(curr);
-#endif             
-            }
+        if (max_fps > 0.0) {
+            const double frame_end = currentFrame + 1.0 / max_fps;
+            const double now = glfwGetTime();
+            if (now < frame_end)
+                std::this_thread::sleep_for(std::chrono::duration<double>(frame_end - now));
+        }
 
-        glBindVertexArray(0);
-        glfwSwapBuffers(window);
+#ifdef UNIFORM_STATS
+        ++stats_frames;
+        if (currentFrame - stats_since >= 1.0f) {
+            Program::Stats stats = hexagon_shader.takeStats();
+            std::cout << "uniforms: " << double(stats.updates) / stats_frames << " updates, "
+                      << double(stats.binds) / stats_frames << " binds per frame" << std::endl;
+            stats_since = currentFrame;
+            stats_frames = 0;
+        }
+#endif
     }
 
-    glDeleteBuffers(1, &VAO);
+    gpu_timer.reset();
+    tile_buffer.reset();
+    if (not trace_path.empty())
+        profiler::writeTrace(trace_path);
+    glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glfwMakeContextCurrent(window);
     glfwTerminate();
@@ -342,18 +439,28 @@ void mouseCallback(GLFWwindow* window, int button, int action, int mods)
 
     if (action != GLFW_PRESS)
         return;
+    redraw_needed = true;
 
 #ifndef KEYBOARD_CONTROL
     double xpos, ypos;
     glfwGetCursorPos(window, &xpos, &ypos);
 
-    game_map.clickOn(Point{mouse_x_NDC(xpos), mouse_y_NDC(ypos)});
+    Status before = game_map.status();
+    const std::size_t ply = game_map.ply();
+    game_map.clickOn(cursorToBoard(xpos, ypos), layout);
+    if (game_map.ply() != ply) {
+        recorder.wall(game_map.journal()[ply].wall);
+        if (sound_wall)
+            sound_wall->play();
+    }
+    reportStatus(before);
 #endif
 }
 
 void cursorCallback(GLFWwindow* window, double xpos, double ypos)
 {
     (void) window;
+    redraw_needed = true;
 
     GLfloat xoffset = xpos - lastX;
     GLfloat yoffset = lastY - ypos;
@@ -379,11 +486,11 @@ void cursorCallback(GLFWwindow* window, double xpos, double ypos)
     front.z = cos(glm::radians(pitch)) * sin(glm::radians(yaw));
     cameraFront = glm::vec3(front);
 #ifndef KEYBOARD_CONTROL
-    game_map.enter(Point{mouse_x_NDC(xpos), mouse_y_NDC(ypos)});
+    game_map.enter(cursorToBoard(xpos, ypos), layout);
 #endif
 }
 
-GLuint createTexture(const char *file_name)
+GLuint createTexture(const char *file_name, const TextureSource& source)
 {
     GLuint texture;
     glGenTextures(1, &texture);
@@ -399,17 +506,27 @@ GLuint createTexture(const char *file_name)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    int width, height;
-    unsigned char* image = SOIL_load_image(file_name, &width, &height, 0, SOIL_LOAD_RGB);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    SOIL_free_image_data(image);
+    uploadTexture(file_name, source);
     glBindTexture(GL_TEXTURE_2D, 0);
     return texture;
 }
 
-float mouse_x_NDC(double x) { return 2 * x/WIDTH + -1.0f; }
-float mouse_y_NDC(double y) { return 2 * (1.0f - y/HEIGHT) + -1.0f; }
+// Cast the cursor ray through the camera onto the board plane z = 0
+Point cursorToBoard(double x, double y)
+{
+    glm::mat4 view = lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+    glm::mat4 projection = glm::perspective(glm::radians(fov), (GLfloat) WIDTH / (GLfloat)HEIGHT, 0.1f, 100.0f);
+    glm::vec4 viewport(0.0f, 0.0f, WIDTH, HEIGHT);
+
+    glm::vec3 near = glm::unProject(glm::vec3(x, HEIGHT - y, 0.0f), view, projection, viewport);
+    glm::vec3 far = glm::unProject(glm::vec3(x, HEIGHT - y, 1.0f), view, projection, viewport);
+
+    if (near.z == far.z)
+        return Point{-1e9f, -1e9f};
+
+    glm::vec3 hit = near + (far - near) * (near.z / (near.z - far.z));
+    return Point{hit.x, hit.y};
+}
 
 void windowScale(GLFWwindow* window, int w, int h)
 {
@@ -418,6 +535,13 @@ void windowScale(GLFWwindow* window, int w, int h)
     WIDTH = w;
     HEIGHT = h;
     glViewport(0, 0, w, h);
+    redraw_needed = true;
+}
+
+void refreshCallback(GLFWwindow* window)
+{
+    (void) window;
+    redraw_needed = true;
 }
 
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode)
@@ -426,6 +550,7 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode
     (void) scancode;
     (void) mode;
     bool success = false;
+    redraw_needed = true;
 
     if (action == GLFW_PRESS) {
 #ifdef KEYBOARD_CONTROL
@@ -436,16 +561,34 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode
         case GLFW_KEY_RIGHT: board_navigation.Right(); break;
         case GLFW_KEY_ENTER:
             success = game_map.setWall(board_navigation.getPosition());
-            if (success && source_wall)
-                source_wall->playAsync();
+            if (success)
+                recorder.wall(game_map.journal()[game_map.ply() - 1].wall);
+            if (success && sound_wall)
+                sound_wall->play();
+            if (success)
+                reportStatus(Status::playing);
+            break;
+        case GLFW_KEY_U:
+        case GLFW_KEY_Y:
+            success = key == GLFW_KEY_U ? game_map.undo() : game_map.redo();
+            if (success and key == GLFW_KEY_U)
+                recorder.undo();
+            else if (success)
+                recorder.redo();
+            if (success and game_map.status() == Status::playing)
+                timer.Unlock();
+            if (success)
+                reportStatus(Status::playing);
+            break;
+        case GLFW_KEY_T:
+            if (not trace_path.empty() and profiler::writeTrace(trace_path))
+                std::cout << "Trace written to " << trace_path << std::endl;
             break;
         case GLFW_KEY_R:
-            game_map = Map();
+            restart();
             timer.Unlock();
-            if (source_with_lock_cat)
-                source_with_lock_cat->unlock();
-            if (source_restart)
-                source_restart->playAsync();
+            if (sound_restart)
+                sound_restart->play();
             break;
         }
 #endif
@@ -472,6 +615,7 @@ void scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
     (void) window;
     (void) xoffset;
+    redraw_needed = true;
 
     if(fov >= 1.0f && fov <= 45.0f)
         fov -= yoffset;
@@ -481,12 +625,113 @@ void scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
         fov = 45.0f;
 }
 
-void doFlip(glm::mat4& model, GLfloat degree) {
-    if (timer.Running()) {
-        model = glm::rotate(model, glm::radians(degree*(timer.GetTime()/FLIP_TIME)), glm::vec3(1.0f, 0.0f, 0.0f));
-    } else {
-        timer.SetTime(FLIP_TIME);
-        timer.Start();
-        timer.Lock();
+// Angle of the cat's flip so far, out of `degree`
+GLfloat flipAngle(GLfloat degree) {
+    if (timer.Running())
+        return degree*(timer.GetTime()/FLIP_TIME);
+
+    timer.SetTime(FLIP_TIME);
+    timer.Start();
+    timer.Lock();
+    return 0.0f;
+}
+
+void reportStatus(Status before) {
+    if (game_map.status() == before)
+        return;
+
+    if (game_map.status() == Status::fail)
+        std::cout << "You have lose!" << std::endl;
+    else if (game_map.status() == Status::win)
+        std::cout << "You have won!" << std::endl;
+}
+
+// Time per frame of every profiled phase since `since`
+void printProfile(std::uint64_t since) {
+    auto summary = profiler::summarize(since);
+
+    std::uint64_t frames = 1;
+    for (auto &s : summary)
+        if (std::string(s.name) == "frame")
+            frames = std::max<std::uint64_t>(s.count, 1);
+
+    std::cout << "profile, " << frames << " frames:\n";
+    for (auto &s : summary)
+        std::cout << "  " << s.name << ": " << double(s.total) / frames / 1e6 << " ms per frame, "
+                  << double(s.max) / 1e6 << " ms max, " << s.count << " calls\n";
+    std::cout << std::flush;
+}
+
+// Input since the last frame, a held camera key or a running animation.
+// Win and fail start their animation on the next frame, then lock the timer.
+bool needsRedraw() {
+    if (redraw_needed)
+        return true;
+    if (keys[GLFW_KEY_W] or keys[GLFW_KEY_A] or keys[GLFW_KEY_S] or keys[GLFW_KEY_D])
+        return true;
+    return game_map.status() != Status::playing and (timer.Running() or not timer.Locked());
+}
+
+void restart() {
+    game_map = Map(settings);
+#ifdef KEYBOARD_CONTROL
+    board_navigation.Select();
+#endif
+    recorder.board(game_map);
+    layout = BoardLayout(game_map.width(), game_map.height());
+}
+
+// catchthecat [--width N] [--height N] [--density D] [--record FILE] [--redraw always|on-demand] [--fps N] [--profile FILE] [--music FILE] [--audio-out FILE]
+bool parseArguments(int argc, char **argv)
+{
+    for (int k = 1; k + 1 < argc; k += 2) {
+        std::string arg = argv[k];
+        if (arg == "--width")
+            settings.width = std::atoi(argv[k + 1]);
+        else if (arg == "--height")
+            settings.height = std::atoi(argv[k + 1]);
+        else if (arg == "--density")
+            settings.wall_density = std::atof(argv[k + 1]);
+        else if (arg == "--redraw") {
+            if (std::string(argv[k + 1]) == "on-demand")
+                on_demand = true;
+            else if (std::string(argv[k + 1]) != "always") {
+                std::cerr << "ERROR: --redraw is always or on-demand" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--profile") {
+            trace_path = argv[k + 1];
+            profiler::enable(true);
+        }
+        else if (arg == "--fps")
+            max_fps = std::atof(argv[k + 1]);
+        else if (arg == "--music")
+            music_path = argv[k + 1];
+        else if (arg == "--audio-out")
+            audio_out = argv[k + 1];
+        else if (arg == "--record") {
+            if (not recorder.open(argv[k + 1])) {
+                std::cerr << "ERROR: can't write " << argv[k + 1] << std::endl;
+                return false;
+            }
+        }
+        else {
+            std::cerr << "ERROR: unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+
+    if (argc % 2 == 0) {
+        std::cerr << "Usage: " << argv[0] << " [--width N] [--height N] [--density D] [--record FILE] [--redraw always|on-demand] [--fps N] [--profile FILE] [--music FILE] [--audio-out FILE]" << std::endl;
+        return false;
+    }
+
+    try {
+        settings.validate();
+    } catch (std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return false;
     }
+    return true;
 }
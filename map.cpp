@@ -1,15 +1,16 @@
 #include <random>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
-#include <thread>
 
 #include "util.hpp"
+#include "profiler.hpp"
+#include "rng.hpp"
 #include "map.hpp"
 
 #define INDENT_FROM_BORDER 3
-
-const int map_width = 10;
-const int map_height = 10;
-const int walls_count = int(map_width*map_height * 0.1); // 10% of all map
+#define LAYERED_DISTANCE_LIMIT 192
+#define GENERATION_ATTEMPTS 1000
 
 float _sign(Point p1, Point p2, Point p3)
 {
@@ -30,6 +31,19 @@ bool Map::inTriangle(Point pt, const Point *v) {
     return !(has_neg && has_pos);
 }
 
+// Same outline as the hexagon drawn by main.cpp
+static const Point unit_hexagon[HEXAGON_VERTEX_COUNT] = {
+    {0.0f, -1.0f}, {-1.0f, -0.5f}, {-1.0f, 0.5f},
+    {0.0f, 1.0f}, {1.0f, 0.5f}, {1.0f, -0.5f}
+};
+
+BoardLayout::BoardLayout(std::size_t width, std::size_t height) {
+    const float x_width = width * stride_x * scale;
+    const float y_width = height * stride_y * scale;
+    x_offset = (2.0f - x_width) / 2 + -1.0f;
+    y_offset = (2.0f - y_width) / 2 + -1.0f;
+}
+
 bool Map::inHexagon(Point pt, const Point *v) {
     const Point t[4][3] = {{v[0], v[1], v[5]},
                            {v[2], v[3], v[4]},
@@ -42,107 +56,543 @@ bool Map::inHexagon(Point pt, const Point *v) {
             inTriangle(pt, t[3]);
 }
 
-Map::Map() {
+void MapSettings::validate() const {
+    if (width < 3 or height < 3)
+        throw std::invalid_argument("Map must be at least 3x3.");
+    // Tiles are numbered with int
+    if (width > std::numeric_limits<int>::max() / height)
+        throw std::invalid_argument("Map is too large.");
+    if (not (wall_density >= 0.0f and wall_density <= 1.0f))
+        throw std::invalid_argument("Wall density must be within [0, 1].");
+}
+
+Map::Map() : Map(MapSettings()) {}
+
+static std::uint64_t randomSeed() {
+    std::random_device device;
+    return std::uint64_t(device()) << 32 | device();
+}
 
+Map::Map(const MapSettings& settings) : Map(randomSeed(), settings) {}
+
+Map::Map(std::uint64_t seed, const MapSettings& settings) {
+    generate(seed, settings);
+}
+
+void Map::generate(std::uint64_t seed, const MapSettings& settings) {
+    profiler::Scope scope("Map::generate");
+
+    settings.validate();
+
+    m_settings = settings;
+    m_seed = seed;
+    Rng random(seed);
+
+    const int map_width = settings.width;
+    const int map_height = settings.height;
+    const int walls_count = int(map_width * map_height * settings.wall_density);
+
+    m_width = map_width;
+    m_height = map_height;
+    m_hover = -1;
+    m_status = Status::playing;
+    m_journal.clear();
+    m_ply = 0;
+    touchAll();
+
+    const int tiles = map_width * map_height;
+
+    // Cat away from the border when the board is big enough. The cat can't
+    // start further from the border than the indent, whatever the walls.
+    const int indent_i = std::min(INDENT_FROM_BORDER, (map_height - 1) / 2);
+    const int indent_j = std::min(INDENT_FROM_BORDER, (map_width - 1) / 2);
+    const int required = std::min({settings.min_escape_distance, indent_i, indent_j});
+
+    // Boards where the cat is already enclosed or about to escape are drawn
+    // again from the same generator, so the seed still decides the board
+    for (int attempt = 0; attempt < GENERATION_ATTEMPTS; ++attempt) {
+        m_types.assign(tiles, HexType::regular);
+        m_opts.assign(tiles, 0);
+        m_board.reset(map_width, map_height);
+
+        // Set finals
+        for (int i = 0; i < map_height; ++i) {
+            m_opts[index(Position{i, 0})] |= static_cast<opt_t>(Option::final);
+            m_opts[index(Position{i, map_width - 1})] |= Option::final;
+            m_board.setFinal(i, 0);
+            m_board.setFinal(i, map_width - 1);
+        }
 
-    m_tiles.resize(map_height);
-    for (int i = 0; i < map_height; ++i)
         for (int j = 0; j < map_width; ++j) {
-            m_tiles[i].resize(map_width);
-            m_tiles[i][j].type = HexType::regular;
+            m_opts[index(Position{0, j})] |= Option::final;
+            m_opts[index(Position{map_height - 1, j})] |= Option::final;
+            m_board.setFinal(0, j);
+            m_board.setFinal(map_height - 1, j);
         }
 
-    // Set finals
-    for (int i = 0; i < map_height; ++i) {
-        m_tiles[i][0].opt |= static_cast<opt_t>(Option::final);
-        m_tiles[i][map_width - 1].opt |= Option::final;
-    }
+        // Set cat
+        Position cat = {
+            indent_i + int(random.below(map_height - indent_i * 2)),
+            indent_j + int(random.below(map_width - indent_j * 2))
+        };
 
-    for (int j = 0; j < map_width; ++j) {
-        m_tiles[0][j].opt |= Option::final;
-        m_tiles[map_height - 1][j].opt |= Option::final;
-    }
+        m_cat = cat;
+        at(cat).type = HexType::cat;
+        m_board.setCat(cat.i, cat.j);
 
-    // Set walls
-    for (int i = 0; i < walls_count; ++i)
-        at( Position{std::rand() % map_height, std::rand() % map_width} ).type = HexType::wall;
+        // Set walls around the cat, the distances are built once they are all down
+        for (int i = 0; i < walls_count; ++i) {
+            const Position p = {int(random.below(map_height)), int(random.below(map_width))};
+            if (at(p).type != HexType::regular)
+                continue;
 
-    // Set cat
-    Position cat = {
-        INDENT_FROM_BORDER + std::rand() % (map_height - INDENT_FROM_BORDER * 2),
-        INDENT_FROM_BORDER + std::rand() % (map_width - INDENT_FROM_BORDER * 2)
-    };
+            at(p).type = HexType::wall;
+            m_board.setWall(p.i, p.j);
+        }
 
-    m_cat.p = cat;
-    m_cat.tile = &at(cat);
-    m_cat.tile->type = HexType::cat;
-}
+        buildDistances();
 
+        const int escape = m_distance[index(m_cat)];
+        if (escape != unreachable and escape >= required)
+            return;
+    }
 
-void Map::clickOn(Point pt) {
-    HexTile *p = nullptr;
-    for (auto &i : m_tiles)
-        for (auto &j : i)
-            if (inHexagon(pt, j.v)) {
-                p = &j;
-                break;
-            }
+    throw std::runtime_error("No playable board found, lower the wall density.");
+}
 
-    if (not p)
-        return;
 
-    turn(*p);
+Position Map::pick(Point pt, const BoardLayout& layout) const {
+    // Undo the board transform, then round in axial hex coordinates where
+    // q = j - (i + (i&1)) / 2 and r = i
+    const float x = (pt.x - layout.x_offset) / layout.scale;
+    const float y = (pt.y - layout.y_offset) / layout.scale;
+
+    const float r = y / layout.stride_y;
+    const float q = x / layout.stride_x - 0.5f - r / 2;
+    const float s = -q - r;
+
+    float rq = std::round(q), rr = std::round(r), rs = std::round(s);
+    const float dq = std::abs(rq - q), dr = std::abs(rr - r), ds = std::abs(rs - s);
+    if (dq > dr and dq > ds)
+        rq = -rr - rs;
+    else if (dr > ds)
+        rr = -rq - rs;
+
+    const int i = int(rr);
+    const int j = int(rq) + (i + (i & 1)) / 2;
+    const Position p = {i, j};
+    if (not within(p))
+        return Position{-1, -1};
+
+    // The rounding cell is wider than the tile, leaving the gaps between tiles
+    const Point local = {
+        x - (j * layout.stride_x + layout.shift * !(i & 1)),
+        y - i * layout.stride_y
+    };
+    if (not inHexagon(local, unit_hexagon))
+        return Position{-1, -1};
+    return p;
 }
 
-void Map::enter(Point pt) {
-    for (auto &i : m_tiles)
-    for (auto &j : i)
-        if (inHexagon(pt, j.v)) {
-            j.opt |= Option::selected;
-        } else
-            j.opt &= ~Option::selected;
+void Map::clickOn(Point pt, const BoardLayout& layout) {
+    const Position p = pick(pt, layout);
+    if (within(p))
+        turn(p);
 }
 
-bool Map::turn(HexTile &tile) {
+void Map::enter(Point pt, const BoardLayout& layout) {
+    if (m_hover >= 0) {
+        m_opts[m_hover] &= ~Option::selected;
+        touch(m_hover);
+    }
+
+    const Position p = pick(pt, layout);
+    m_hover = within(p) ? index(p) : -1;
 
-    if (tile.type != HexType::regular or m_status != Status::playing)
+    if (m_hover >= 0) {
+        m_opts[m_hover] |= Option::selected;
+        touch(m_hover);
+    }
+}
+
+bool Map::turn(Position p) {
+    profiler::Scope scope("Map::turn");
+
+    if (at(p).type != HexType::regular or m_status != Status::playing)
         return false;
 
-    tile.type = HexType::wall;
+    Move move = {index(p), index(m_cat), index(m_cat), Status::playing};
+
+    m_types[move.wall] = HexType::wall;
+    touch(move.wall);
+    m_board.setWall(p.i, p.j);
+    repairDistances(move.wall);
 
 #ifdef PATH_HIGHLIGHT
-    for (auto &i : m_tiles)
-        for (auto &j : i)
-            j.opt &= ~Option::way_higlight;
+    for (auto &opt : m_opts)
+        opt &= ~Option::way_higlight;
+    touchAll();
 #endif
 
-    Way way = findShortestWay(m_cat.p);
+#if defined(FULL_PATH_SEARCH)
+    Way way = findShortestWay(m_cat);
+#elif defined(PATH_HIGHLIGHT)
+    Way way = wayFromDistances(m_cat);
+#else
+    Way way = wayFromDistances(m_cat, 1);
+#endif
 
-    if (not way.empty() and way.front().tile->opt & Option::final) {
-        std::cout << "You have lose!" << std::endl;
-        m_status = Status::fail;
-    }
-    else if (way.empty()) {
-        std::cout << "You have won!" << std::endl;
-        m_status = Status::win;
-    }
+    if (not way.empty() and at(way.front()).opt & Option::final)
+        move.status = Status::fail;
+    else if (way.empty())
+        move.status = Status::win;
 
     if (not way.empty()) {
 #ifdef PATH_HIGHLIGHT
         for (auto i = way.begin(); i < way.end(); ++i)
-            i->tile->opt |= Option::way_higlight;
+            at(*i).opt |= Option::way_higlight;
 #endif
+        move.cat_to = index(way.front());
+    }
 
-        m_cat.tile->type = HexType::regular;
+    // A new turn drops the undone ones
+    m_journal.resize(m_ply);
+    m_journal.push_back(move);
 
-        m_cat = way.front();
-        m_cat.tile->type = HexType::cat;
-    }
+    // The wall and distances are already in place
+    moveCat(move);
+    ++m_ply;
 
     return true;
 };
 
-Map::Way Map::findShortestWay(Position p, Way way, std::vector<HexTile_Info> prohibit, Way::size_type max_length) {
+void Map::apply(const Move& move) {
+    const Position wall = position(move.wall);
+    m_types[move.wall] = HexType::wall;
+    touch(move.wall);
+    m_board.setWall(wall.i, wall.j);
+    repairDistances(move.wall);
+    moveCat(move);
+}
+
+void Map::moveCat(const Move& move) {
+    m_types[move.cat_from] = HexType::regular;
+    m_types[move.cat_to] = HexType::cat;
+    touch(move.cat_from);
+    touch(move.cat_to);
+    m_cat = position(move.cat_to);
+    m_board.setCat(m_cat.i, m_cat.j);
+    m_status = move.status;
+}
+
+bool Map::undo() {
+    if (m_ply == 0)
+        return false;
+
+    const Move& move = m_journal[--m_ply];
+
+    m_types[move.cat_to] = HexType::regular;
+    m_types[move.cat_from] = HexType::cat;
+    touch(move.cat_to);
+    touch(move.cat_from);
+    m_cat = position(move.cat_from);
+    m_board.setCat(m_cat.i, m_cat.j);
+    m_status = Status::playing;
+
+    const Position wall = position(move.wall);
+    m_types[move.wall] = HexType::regular;
+    touch(move.wall);
+    m_board.clearWall(wall.i, wall.j);
+    freeDistances(move.wall);
+
+#ifdef PATH_HIGHLIGHT
+    for (auto &opt : m_opts)
+        opt &= ~Option::way_higlight;
+    touchAll();
+#endif
+
+    return true;
+}
+
+bool Map::redo() {
+    if (m_ply == m_journal.size())
+        return false;
+
+    apply(m_journal[m_ply++]);
+    return true;
+}
+
+int Map::neighbors(int index, int (&out)[6]) const {
+    const Position p = position(index);
+
+    const Position neighbors_positions[6] = {
+        {p.i+1, p.j - (p.i&1)}, {p.i+1, p.j+1 - (p.i&1)},
+        {p.i, p.j-1}, {p.i, p.j+1},
+        {p.i-1, p.j - (p.i&1)}, {p.i-1, p.j+1 - (p.i&1)}
+    };
+
+    int count = 0;
+    for (auto &n : neighbors_positions)
+        if (within(n))
+            out[count++] = this->index(n);
+    return count;
+}
+
+void Map::buildDistances() {
+    // Bit layers cost a pass over the board per step of distance, so once
+    // the middle is far from the border a plain breadth-first search wins
+    const int w = m_width, h = m_height;
+    if (std::min(w, h) / 2 < LAYERED_DISTANCE_LIMIT) {
+        m_board.borderDistances(m_distance, unreachable);
+        return;
+    }
+
+    m_distance.assign(width() * height(), unreachable);
+    m_queue.resize(width() * height());
+
+    // The queue holds tile indices, the row of each is found once when it
+    // is taken off
+    int* distance = m_distance.data();
+    const HexType* types = m_types.data();
+    int* queue = m_queue.data();
+
+    std::vector<int>::size_type head = 0, tail = 0;
+    for (int i = 0; i < h; ++i)
+        for (int j = 0; j < w; ++j) {
+            const int k = i * w + j;
+            if (m_opts[k] & Option::final and types[k] != HexType::wall) {
+                distance[k] = 0;
+                queue[tail++] = k;
+            }
+        }
+
+    // Neighbours unrolled from the table of findShortestWay
+    while (head < tail) {
+        const int current = queue[head++];
+        const int i = current / w, j = current - i * w;
+        const int odd = i & 1;
+        const int d = distance[current] + 1;
+
+        auto visit = [&](int ni, int nj) {
+            const int next = ni * w + nj;
+            if (distance[next] == unreachable and types[next] != HexType::wall) {
+                distance[next] = d;
+                queue[tail++] = next;
+            }
+        };
+
+        if (j > 0)
+            visit(i, j - 1);
+        if (j + 1 < w)
+            visit(i, j + 1);
+        if (i > 0) {
+            if (j - odd >= 0)
+                visit(i - 1, j - odd);
+            if (j + 1 - odd < w)
+                visit(i - 1, j + 1 - odd);
+        }
+        if (i + 1 < h) {
+            if (j - odd >= 0)
+                visit(i + 1, j - odd);
+            if (j + 1 - odd < w)
+                visit(i + 1, j + 1 - odd);
+        }
+    }
+}
+
+void Map::repairDistances(int wall) {
+    const int old = m_distance[wall];
+    m_distance[wall] = unreachable;
+    if (old == unreachable)
+        return;
+
+    // Walls only make distances grow, so the only tiles to fix are the ones
+    // that lose their last neighbour one step closer to the border.
+    int n[6];
+    int count = neighbors(wall, n);
+    m_stack.clear();
+    for (int k = 0; k < count; ++k)
+        if (m_distance[n[k]] == old + 1)
+            m_stack.push_back(n[k]);
+
+    m_affected.clear();
+    while (not m_stack.empty()) {
+        const int current = m_stack.back();
+        m_stack.pop_back();
+
+        const int d = m_distance[current];
+        if (d == unreachable or d == 0)
+            continue;
+
+        bool supported = false;
+        count = neighbors(current, n);
+        for (int k = 0; k < count and not supported; ++k)
+            supported = m_distance[n[k]] == d - 1;
+        if (supported)
+            continue;
+
+        m_distance[current] = unreachable;
+        m_affected.push_back(current);
+        for (int k = 0; k < count; ++k)
+            if (m_distance[n[k]] == d + 1)
+                m_stack.push_back(n[k]);
+    }
+
+    // Settle the invalidated tiles from their untouched neighbours
+    auto closer = [](const std::pair<int, int>& a, const std::pair<int, int>& b) { return a.first > b.first; };
+    m_heap.clear();
+    for (int current : m_affected) {
+        count = neighbors(current, n);
+        for (int k = 0; k < count; ++k)
+            if (m_distance[n[k]] != unreachable and m_distance[n[k]] + 1 < m_distance[current])
+                m_distance[current] = m_distance[n[k]] + 1;
+
+        if (m_distance[current] != unreachable) {
+            m_heap.emplace_back(m_distance[current], current);
+            std::push_heap(m_heap.begin(), m_heap.end(), closer);
+        }
+    }
+
+    while (not m_heap.empty()) {
+        std::pop_heap(m_heap.begin(), m_heap.end(), closer);
+        const auto [d, current] = m_heap.back();
+        m_heap.pop_back();
+
+        if (d > m_distance[current])
+            continue;
+
+        count = neighbors(current, n);
+        for (int k = 0; k < count; ++k)
+            if (d + 1 < m_distance[n[k]] and m_types[n[k]] != HexType::wall) {
+                m_distance[n[k]] = d + 1;
+                m_heap.emplace_back(d + 1, n[k]);
+                std::push_heap(m_heap.begin(), m_heap.end(), closer);
+            }
+    }
+}
+
+// Inverse of repairDistances: a wall is gone, so distances can only drop,
+// and only on tiles whose shortest way now goes through the freed one
+void Map::freeDistances(int tile) {
+    int n[6], count;
+
+    int d = unreachable;
+    if (m_opts[tile] & Option::final)
+        d = 0;
+    else {
+        count = neighbors(tile, n);
+        for (int k = 0; k < count; ++k)
+            if (m_distance[n[k]] != unreachable and m_distance[n[k]] + 1 < d)
+                d = m_distance[n[k]] + 1;
+    }
+
+    m_distance[tile] = d;
+    if (d == unreachable)
+        return;
+
+    // Every step out of the freed tile costs one, so first in first out
+    // settles the tiles in order of their new distance
+    m_queue.resize(width() * height());
+    std::vector<int>::size_type head = 0, tail = 0;
+    m_queue[tail++] = tile;
+
+    while (head < tail) {
+        const int current = m_queue[head++];
+        const int next = m_distance[current] + 1;
+
+        count = neighbors(current, n);
+        for (int k = 0; k < count; ++k)
+            if (next < m_distance[n[k]] and m_types[n[k]] != HexType::wall) {
+                m_distance[n[k]] = next;
+                m_queue[tail++] = n[k];
+            }
+    }
+}
+
+Map::Way Map::wayFromDistances(Position p, Way::size_type max_length) {
+    profiler::Scope scope("Map::wayFromDistances");
+
+    Way way;
+
+    int current = index(p);
+    while (way.size() < max_length and m_distance[current] != unreachable and m_distance[current] > 0) {
+        int n[6];
+        const int count = neighbors(current, n);
+        for (int k = 0; k < count; ++k)
+            if (m_distance[n[k]] == m_distance[current] - 1) {
+                current = n[k];
+                break;
+            }
+
+        way.push_back(position(current));
+    }
+    return way;
+}
+
+Map::Way Map::findShortestWay(Position p) {
+    profiler::Scope scope("Map::findShortestWay");
+
+#ifdef RECURSIVE_PATHFINDING
+    return findShortestWayRecursive(p);
+#else
+    return findShortestWayBFS(p);
+#endif
+}
+
+Map::Way Map::findShortestWayBFS(Position p) {
+    if (this->at(p).opt & Option::final)
+        return Way();
+
+    const int w = int(width());
+    const int start = p.i * w + p.j;
+
+    m_queue.resize(width() * height());
+    m_parent.assign(width() * height(), -1);
+    m_parent[start] = start;
+
+    std::vector<int>::size_type head = 0, tail = 0;
+    m_queue[tail++] = start;
+
+    int found = -1;
+    while (head < tail and found < 0) {
+        const int index = m_queue[head++];
+        const Position c = {index / w, index % w};
+
+        // Same order as the neighbors table of the recursive search
+        Position neighbors_positions[6] = {
+            {c.i+1, c.j - (c.i&1)}, {c.i+1, c.j+1 - (c.i&1)},
+            {c.i, c.j-1}, {c.i, c.j+1},
+            {c.i-1, c.j - (c.i&1)}, {c.i-1, c.j+1 - (c.i&1)}
+        };
+
+        for (auto &n : neighbors_positions) {
+            if (not within(n))
+                continue;
+
+            const int next = n.i * w + n.j;
+            if (m_parent[next] >= 0 or m_types[next] == HexType::wall)
+                continue;
+
+            m_parent[next] = index;
+            if (m_opts[next] & Option::final) {
+                found = next;
+                break;
+            }
+            m_queue[tail++] = next;
+        }
+    }
+
+    Way way;
+    if (found < 0)
+        return way;
+
+    for (int index = found; index != start; index = m_parent[index])
+        way.push_back(Position{index / w, index % w});
+    std::reverse(way.begin(), way.end());
+    return way;
+}
+
+Map::Way Map::findShortestWayRecursive(Position p, Way way, Way prohibit, Way::size_type max_length) {
     if (this->at(p).opt & Option::final) {
         return way;
     }
@@ -160,18 +610,15 @@ Map::Way Map::findShortestWay(Position p, Way way, std::vector<HexTile_Info> pro
         {p.i-1, p.j - (p.i&1)}, {p.i-1, p.j+1 - (p.i&1)}
     };
 
-    std::vector<HexTile_Info> neighbors;
+    Way neighbors;
     for (int i = 0; i < 6; ++i)
         if (within(neighbors_positions[i]) and
             at(neighbors_positions[i]).type != HexType::wall and
-            not contains(prohibit, &at(neighbors_positions[i])))
-            neighbors.push_back(HexTile_Info{
-                                    &at(neighbors_positions[i]),
-                                    neighbors_positions[i]
-                                });
+            not contains(prohibit, neighbors_positions[i]))
+            neighbors.push_back(neighbors_positions[i]);
 
     if (prohibit.empty())
-        prohibit.push_back(HexTile_Info{&at(p), p});
+        prohibit.push_back(p);
 
     prohibit.insert(prohibit.end(), neighbors.begin(), neighbors.end());
 
@@ -180,10 +627,10 @@ Map::Way Map::findShortestWay(Position p, Way way, std::vector<HexTile_Info> pro
         Way new_way(way);
         new_way.push_back(i);
 
-        if (i.p.i == 3 && i.p.j == 8)
+        if (i.i == 3 && i.j == 8)
             std::cout << "";
 
-        new_way = findShortestWay(i.p, new_way, prohibit, max_length);
+        new_way = findShortestWayRecursive(i, new_way, prohibit, max_length);
 
         if (not new_way.empty()) {
             max_length = std::min(max_length, new_way.size());
@@ -193,7 +640,7 @@ Map::Way Map::findShortestWay(Position p, Way way, std::vector<HexTile_Info> pro
 
     // If no possible ways than check given one and if that is not final return empty way
     if (possible_ways.empty()) {
-        if (not way.empty() and way.back().tile->opt & Option::final) {
+        if (not way.empty() and at(way.back()).opt & Option::final) {
             return way;
         }
         else {
@@ -217,29 +664,48 @@ Map::Way Map::findShortestWay(Position p, Way way, std::vector<HexTile_Info> pro
 void Map::select(Position p)
 {
     at(p).opt |= Option::selected;
+    touch(index(p));
 }
 
 void Map::deselect(Position p)
 {
     at(p).opt &= ~Option::selected;
+    touch(index(p));
+}
+
+void Map::touchAll()
+{
+    m_all_dirty = true;
+    m_dirty.clear();
+}
+
+void Map::clearDirty()
+{
+    if (m_all_dirty)
+        m_dirty_mark.assign(m_types.size(), 0);
+    for (int k : m_dirty)
+        m_dirty_mark[k] = 0;
+
+    m_dirty.clear();
+    m_all_dirty = false;
 }
 
 bool Map::setWall(Position p)
 {
-    return turn(at(p));
+    return turn(p);
 }
 
 bool Map::within(Position p) const {
     return p.i >= 0 and
            p.j >= 0 and
-           Tiles::size_type(p.i) < height() and
-           Tiles::size_type(p.j) < width();
+           size_type(p.i) < height() and
+           size_type(p.j) < width();
 }
 
-bool Map::contains(const Way& way, const HexTile* tile)
+bool Map::contains(const Way& way, Position p)
 {
     for (auto& i : way)
-        if (i.tile == tile)
+        if (i.i == p.i and i.j == p.j)
             return true;
     return false;
 }
@@ -1,13 +1,19 @@
 #ifndef MAP_HPP
 #define MAP_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
 #include <vector>
 #include <stdexcept>
 #include <limits>
+#include <utility>
+
+#include "bitboard.hpp"
 
 #define HEXAGON_VERTEX_COUNT 6
 
-using opt_t = unsigned;
+using opt_t = std::uint8_t;
 
 struct Position {
     int i, j;
@@ -17,7 +23,7 @@ struct Point {
     float x, y;
 };
 
-enum class HexType {
+enum class HexType : std::uint8_t {
     regular,
     wall,
     cat
@@ -36,65 +42,199 @@ enum Option {
     prohibited = 1 << 3,
 };
 
+struct MapSettings {
+    int width = 10;
+    int height = 10;
+    float wall_density = 0.1f; // Share of the tiles turned into walls
+    int min_escape_distance = 2; // Fewest steps from the cat to a final tile on a fresh board
+
+    // Throws std::invalid_argument for sizes or a density no board can have.
+    // Whether the density leaves a playable board is only known by drawing one.
+    void validate() const;
+};
+
+// One turn of the journal: the wall placed, where the cat went and the
+// status it left. Tiles are row-major indices i * width + j.
+struct Move {
+    int wall;
+    int cat_from;
+    int cat_to;
+    Status status;
+};
+
+// View of one tile in Map's storage
 struct HexTile {
-    Point v[HEXAGON_VERTEX_COUNT];
-    HexType type;
-    opt_t opt;
+    HexType& type;
+    opt_t& opt;
 };
 
-struct HexTile_Info {
-    HexTile* tile;
-    Position p;
+// Where the board is drawn: tile (i, j) is the unit hexagon scaled by `scale`
+// and centred at offset + scale * (j * stride_x + shift * !(i & 1), i * stride_y)
+struct BoardLayout {
+    float scale = 0.60f;
+    float edge = 0.30f;
+    float stride_x = 1.0f + 0.5f + edge + 0.5f;
+    float stride_y = 1.0f + 0.5f + edge;
+    float shift = 1.0f + edge / 2;
+    float x_offset = 0.0f;
+    float y_offset = 0.0f;
+
+    BoardLayout() = default;
+    BoardLayout(std::size_t width, std::size_t height);
 };
 
 class Map {
 
-    //      v4
-    //      /\
-    //  v3 /  \ v5
-    //    |    |
-    //    |    |
-    //  v2 \  / v6
-    //      \/
-    //      v1
+    /*      v4
+     *      /\
+     *  v3 /  \ v5
+     *    |    |
+     *    |    |
+     *  v2 \  / v6
+     *      \/
+     *      v1
+     */
 
-    using Tiles = std::vector<std::vector<HexTile>>;
-    using Way = std::vector<HexTile_Info>;
+    using Way = std::vector<Position>;
 
-    Tiles m_tiles; // NDC Coordinates
-    HexTile_Info m_cat = {nullptr, Position{0, 0}};
-    Status m_status = Status::playing;
+    MapSettings m_settings;
+    std::uint64_t m_seed = 0;
 
-    bool inHexagon(Point pt, const Point *v);
-    bool inTriangle(Point pt, const Point *v);
-    bool contains(const Way& way, const HexTile* tile);
+    // Row-major tile storage, one array per field
+    int m_width = 0, m_height = 0;
+    std::vector<HexType> m_types;
+    std::vector<opt_t> m_opts;
+    int m_hover = -1; // Tile under the cursor
 
-    Way findShortestWay(Position p, Way way = Way(), std::vector<HexTile_Info> prohibit = std::vector<HexTile_Info>(), Way::size_type max_length = std::numeric_limits<Way::size_type>::max());
-    bool turn(HexTile& tile);
+    Position m_cat = {0, 0};
+    Status m_status = Status::playing;
+    BitBoard m_board;
+
+    // Tiles whose type or options changed since clearDirty(), each listed
+    // once. A new or loaded board is dirty as a whole.
+    std::vector<int> m_dirty;
+    std::vector<std::uint8_t> m_dirty_mark;
+    bool m_all_dirty = true;
+
+    void touch(int index) {
+        if (m_all_dirty or m_dirty_mark[index])
+            return;
+        m_dirty_mark[index] = 1;
+        m_dirty.push_back(index);
+    }
+    void touchAll();
+
+    // Turns played so far, then the undone ones still available to redo
+    std::vector<Move> m_journal;
+    std::size_t m_ply = 0;
+
+    static bool inHexagon(Point pt, const Point *v);
+    static bool inTriangle(Point pt, const Point *v);
+    bool contains(const Way& way, Position p);
+
+    // Scratch space of the breadth-first engine, sized once per board
+    std::vector<int> m_queue;
+    std::vector<int> m_parent;
+
+    // Distance from every tile to the nearest final tile, kept up to date
+    // by turn(). Walls and enclosed tiles are unreachable.
+    std::vector<int> m_distance;
+    std::vector<int> m_stack;
+    std::vector<int> m_affected;
+    std::vector<std::pair<int, int>> m_heap;
+
+    int index(Position p) const { return p.i * int(width()) + p.j; }
+    Position position(int index) const { return Position{index / int(width()), index % int(width())}; }
+    int neighbors(int index, int (&out)[6]) const;
+
+    void buildDistances();
+    void repairDistances(int wall);
+    void freeDistances(int tile);
+    void apply(const Move& move);
+    void moveCat(const Move& move);
+    Way wayFromDistances(Position p, Way::size_type max_length = std::numeric_limits<Way::size_type>::max());
+
+    Way findShortestWay(Position p);
+    Way findShortestWayBFS(Position p);
+    Way findShortestWayRecursive(Position p, Way way = Way(), Way prohibit = Way(), Way::size_type max_length = std::numeric_limits<Way::size_type>::max());
+    bool turn(Position p);
 public:
+    using size_type = std::size_t;
+
+    static constexpr int unreachable = std::numeric_limits<int>::max();
+
+    // Bytes stored per tile: a HexTile used to hold the vertices, type and
+    // options together (56 bytes), pathfinding now only touches the first two
+    static constexpr std::size_t legacy_tile_bytes = sizeof(Point) * HEXAGON_VERTEX_COUNT + 2 * sizeof(unsigned);
+    static constexpr std::size_t tile_state_bytes = sizeof(HexType) + sizeof(opt_t);
+    static constexpr std::size_t tile_distance_bytes = sizeof(int);
+
     Map();
+    explicit Map(const MapSettings& settings);
+    explicit Map(std::uint64_t seed, const MapSettings& settings = MapSettings());
+
+    // Draw a new board in place, reusing the storage. The same seed and
+    // settings give the same board on every platform.
+    void generate(std::uint64_t seed, const MapSettings& settings);
+
+    // Binary snapshot of the board: the tile arrays, distances and bit rows
+    // are stored as they are in memory, so loading is a copy out of the
+    // mapped file. The journal is not saved. Throw std::runtime_error, and
+    // load() also on tiles or distances that don't agree with each other.
+    void save(const std::string& path) const;
+    void load(const std::string& path);
+
+    const MapSettings& settings() const { return m_settings; }
+    std::uint64_t seed() const { return m_seed; }
 
-    void clickOn(Point pt);
-    void enter(Point pt);
+    // Tile under a point of the board plane, {-1, -1} between tiles
+    Position pick(Point pt, const BoardLayout& layout) const;
+    void clickOn(Point pt, const BoardLayout& layout);
+    void enter(Point pt, const BoardLayout& layout);
 
     bool setWall(Position p);
+
+    // Step through the journal. Both only touch the tiles of the move and
+    // the distances it changed, false when there is nothing to step to.
+    bool undo();
+    bool redo();
+    std::size_t ply() const { return m_ply; }
+    const std::vector<Move>& journal() const { return m_journal; }
     void select(Position p);
     void deselect(Position p);
     bool within(Position p) const;
     Status status() const;
+    Position cat() const { return m_cat; }
+    int distance(Position p) const { return m_distance[index(p)]; }
+    const BitBoard& board() const { return m_board; }
+    bool canEscape() const { return m_board.canEscape(); }
 
-    Tiles::size_type height() const { return m_tiles.size(); }
-    Tiles::size_type width() const { return m_tiles[0].size(); }
+    size_type height() const { return size_type(m_height); }
+    size_type width() const { return size_type(m_width); }
 
-    HexTile& at(Tiles::size_type i, Tiles::size_type j) {
+    HexTile at(size_type i, size_type j) {
         if (i >= height() or j >= width())
             throw std::out_of_range("Hexagon is not exist.");
-        return m_tiles[i][j];
+        const size_type k = i * width() + j;
+        return HexTile{m_types[k], m_opts[k]};
     }
 
-    HexTile& at(Position p) {
-        return this->at(Tiles::size_type(p.i), Tiles::size_type(p.j));
+    HexTile at(Position p) {
+        return this->at(size_type(p.i), size_type(p.j));
     }
 
+    HexType type(Position p) const { return m_types[index(p)]; }
+    opt_t options(Position p) const { return m_opts[index(p)]; }
+
+    // Changes for a renderer: either the whole board or the listed tiles.
+    // Writes through at() are not tracked.
+    bool allDirty() const { return m_all_dirty; }
+    const std::vector<int>& dirtyTiles() const { return m_dirty; }
+    void clearDirty();
+
+    // Row-major tile arrays, width() * height() long
+    const HexType* types() const { return m_types.data(); }
+    const opt_t* options() const { return m_opts.data(); }
+
 };
 #endif // MAP_HPP
@@ -0,0 +1,36 @@
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped_file.hpp"
+
+MappedFile::MappedFile(const std::string& path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Can't open " + path + ".");
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0 or st.st_size == 0) {
+        ::close(fd);
+        throw std::runtime_error(path + " is empty.");
+    }
+
+    m_size = std::size_t(st.st_size);
+    void *data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+        throw std::runtime_error("Can't map " + path + ".");
+
+    // Every reader goes through the file front to back
+    ::madvise(data, m_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const unsigned char *>(data);
+}
+
+MappedFile::~MappedFile()
+{
+    ::munmap(const_cast<unsigned char *>(m_data), m_size);
+}
@@ -0,0 +1,24 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+// A whole file mapped read-only into memory, unmapped on destruction
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char *data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+
+private:
+    const unsigned char *m_data = nullptr;
+    std::size_t m_size = 0;
+};
+
+#endif // MAPPED_FILE_HPP
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mixer.hpp"
+
+// Headless mixer benchmark: keeps every voice busy with short tones, the
+// way overlapping effects play in the game, and reports how many voices'
+// worth of audio the software mixer renders per millisecond.
+
+#define CLIP_RATE 22050 // Like the game's effects
+#define BLOCK 1024      // Frames rendered at a time
+
+struct Options {
+    int voices = 16;
+    double seconds = 60; // Of audio
+    std::string out;     // WAV of the mix
+};
+
+static void usage(const char *name)
+{
+    std::cerr << "Usage: " << name << " [--voices N] [--seconds S] [--out FILE]" << std::endl;
+}
+
+static bool parse(int argc, char **argv, Options& o)
+{
+    if (argc % 2 == 0)
+        return false;
+
+    for (int k = 1; k + 1 < argc; k += 2) {
+        const char *arg = argv[k], *value = argv[k + 1];
+        if (not std::strcmp(arg, "--voices"))
+            o.voices = std::max(1, std::atoi(value));
+        else if (not std::strcmp(arg, "--seconds"))
+            o.seconds = std::max(0.1, std::atof(value));
+        else if (not std::strcmp(arg, "--out"))
+            o.out = value;
+        else {
+            std::cerr << "ERROR: unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    Options o;
+    if (not parse(argc, argv, o)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Mixer mixer;
+    WavWriter out;
+    if (not o.out.empty() and not out.open(o.out, mixer.rate())) {
+        std::cerr << "ERROR: can't write " << o.out << std::endl;
+        return 1;
+    }
+
+    // Decaying tones of a few pitches, 16-bit mono like the game's clips
+    std::vector<unsigned> clips;
+    for (int k = 0; k < 8; ++k) {
+        std::vector<std::int16_t> pcm(CLIP_RATE / 4);
+        for (std::size_t i = 0; i < pcm.size(); ++i) {
+            const double t = double(i) / CLIP_RATE;
+            pcm[i] = std::int16_t(4000 * std::exp(-8 * t) * std::sin(2 * M_PI * (220 << (k % 4)) * (1 + k / 4) * t));
+        }
+        clips.push_back(mixer.createBuffer());
+        mixer.bufferData(clips.back(), Mixer::Format::Mono16, pcm.data(), pcm.size() * 2, CLIP_RATE);
+    }
+
+    std::vector<unsigned> voices;
+    for (int k = 0; k < o.voices; ++k)
+        voices.push_back(mixer.createVoice());
+
+    using clock = std::chrono::steady_clock;
+    std::vector<float> mix(2 * BLOCK);
+    std::vector<std::int16_t> pcm(2 * BLOCK);
+    const std::uint64_t frames = std::uint64_t(o.seconds * mixer.rate());
+    std::uint64_t rendered = 0, restarts = 0;
+    double seconds = 0;
+
+    while (rendered < frames) {
+        // Voices that ran out start the next clip, outside the timing
+        for (std::size_t k = 0; k < voices.size(); ++k)
+            if (not mixer.playing(voices[k])) {
+                mixer.attach(voices[k], clips[(k + restarts) % clips.size()]);
+                mixer.play(voices[k]);
+                ++restarts;
+            }
+
+        const std::size_t block = std::size_t(std::min<std::uint64_t>(BLOCK, frames - rendered));
+        auto begin = clock::now();
+        mixer.render(mix.data(), block);
+        floatToPcm16(mix.data(), pcm.data(), 2 * block);
+        seconds += std::chrono::duration<double>(clock::now() - begin).count();
+
+        if (not o.out.empty())
+            out.write(pcm.data(), block);
+        rendered += block;
+    }
+
+    if (not o.out.empty() and not out.close()) {
+        std::cerr << "ERROR: can't write " << o.out << std::endl;
+        return 1;
+    }
+
+    const double audio_ms = 1000.0 * double(rendered) / mixer.rate();
+    std::cout << "voices:        " << o.voices << ", " << restarts << " clips started\n"
+              << "audio:         " << audio_ms / 1000 << " s at " << mixer.rate() << " Hz stereo\n"
+              << "mix time:      " << seconds * 1000 << " ms, " << audio_ms / (seconds * 1000) << "x real time\n"
+              << "voices per ms: " << o.voices * audio_ms / (seconds * 1000)
+              << " (voice-milliseconds of audio mixed per millisecond)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "mixer.hpp"
+
+unsigned Mixer::createBuffer()
+{
+    auto free = std::find_if(m_buffers.begin(), m_buffers.end(), [](const Buffer& b) { return not b.used; });
+    if (free == m_buffers.end())
+        free = m_buffers.insert(free, Buffer());
+    free->used = true;
+    return unsigned(free - m_buffers.begin()) + 1;
+}
+
+void Mixer::deleteBuffer(unsigned buffer)
+{
+    if (not hasBuffer(buffer))
+        return;
+    m_buffers[buffer - 1] = Buffer();
+}
+
+// Little-endian sample `index` of a channel, as a float in [-1, 1)
+static float pcmSample(const unsigned char *data, bool wide, std::size_t index)
+{
+    if (not wide)
+        return (float(data[index]) - 128.0f) / 128.0f;
+    const std::int16_t value = std::int16_t(data[2 * index] | data[2 * index + 1] << 8);
+    return float(value) / 32768.0f;
+}
+
+void Mixer::bufferData(unsigned buffer, Format format, const void *data, std::size_t bytes, int rate)
+{
+    if (not hasBuffer(buffer) or rate <= 0)
+        return;
+
+    const bool stereo = format == Format::Stereo8 or format == Format::Stereo16;
+    const bool wide = format == Format::Mono16 or format == Format::Stereo16;
+    const std::size_t channels = stereo ? 2 : 1;
+    const std::size_t frames = bytes / (channels * (wide ? 2 : 1));
+    const auto *pcm = static_cast<const unsigned char *>(data);
+
+    // Linear resampling, done once so render() only scales and adds
+    std::vector<float>& out = m_buffers[buffer - 1].samples;
+    const std::size_t length = frames ? std::size_t(double(frames) * m_rate / rate) : 0;
+    out.resize(2 * length);
+    const double step = double(rate) / m_rate;
+    for (std::size_t k = 0; k < length; ++k) {
+        const double at = k * step;
+        const std::size_t i = std::min(std::size_t(at), frames - 1);
+        const std::size_t j = std::min(i + 1, frames - 1);
+        const float t = float(at - double(i));
+        for (std::size_t c = 0; c < 2; ++c) {
+            const std::size_t channel = stereo ? c : 0;
+            const float a = pcmSample(pcm, wide, i * channels + channel);
+            const float b = pcmSample(pcm, wide, j * channels + channel);
+            out[2 * k + c] = a + (b - a) * t;
+        }
+    }
+}
+
+unsigned Mixer::createVoice()
+{
+    auto free = std::find_if(m_voices.begin(), m_voices.end(), [](const Voice& v) { return not v.used; });
+    if (free == m_voices.end())
+        free = m_voices.insert(free, Voice());
+    free->used = true;
+    return unsigned(free - m_voices.begin()) + 1;
+}
+
+void Mixer::deleteVoice(unsigned voice)
+{
+    if (not hasVoice(voice))
+        return;
+    m_voices[voice - 1] = Voice();
+}
+
+void Mixer::setGain(unsigned voice, float gain)
+{
+    if (not hasVoice(voice))
+        return;
+    m_voices[voice - 1].gain = gain;
+}
+
+void Mixer::attach(unsigned voice, unsigned buffer)
+{
+    if (not hasVoice(voice))
+        return;
+    Voice& v = m_voices[voice - 1];
+    v.playing = false;
+    v.queue.clear();
+    v.current = v.frame = 0;
+    if (hasBuffer(buffer))
+        v.queue.push_back(buffer);
+}
+
+void Mixer::queue(unsigned voice, unsigned buffer)
+{
+    if (not hasVoice(voice) or not hasBuffer(buffer))
+        return;
+    m_voices[voice - 1].queue.push_back(buffer);
+}
+
+unsigned Mixer::unqueue(unsigned voice)
+{
+    if (processed(voice) == 0)
+        return 0;
+
+    Voice& v = m_voices[voice - 1];
+    const unsigned buffer = v.queue.front();
+    v.queue.pop_front();
+    if (v.current > 0)
+        --v.current;
+    return buffer;
+}
+
+std::size_t Mixer::processed(unsigned voice) const
+{
+    if (not hasVoice(voice))
+        return 0;
+    // A stopped source has played all of its queue, as in OpenAL
+    const Voice& v = m_voices[voice - 1];
+    return v.playing ? v.current : v.queue.size();
+}
+
+std::size_t Mixer::queued(unsigned voice) const
+{
+    if (not hasVoice(voice))
+        return 0;
+    return m_voices[voice - 1].queue.size();
+}
+
+void Mixer::play(unsigned voice)
+{
+    if (not hasVoice(voice))
+        return;
+    Voice& v = m_voices[voice - 1];
+    v.current = v.frame = 0;
+    v.playing = not v.queue.empty();
+}
+
+void Mixer::stop(unsigned voice)
+{
+    if (not hasVoice(voice))
+        return;
+    m_voices[voice - 1].playing = false;
+}
+
+bool Mixer::playing(unsigned voice) const
+{
+    if (not hasVoice(voice))
+        return false;
+    return m_voices[voice - 1].playing;
+}
+
+bool Mixer::active() const
+{
+    return std::any_of(m_voices.begin(), m_voices.end(), [](const Voice& v) { return v.playing; });
+}
+
+void Mixer::render(float *out, std::size_t frames)
+{
+    std::memset(out, 0, 2 * frames * sizeof(float));
+
+    for (Voice& v : m_voices) {
+        std::size_t done = 0;
+        while (v.playing and done < frames) {
+            const unsigned buffer = v.queue[v.current];
+            const std::vector<float>& samples = m_buffers[buffer - 1].samples;
+            // A buffer deleted while queued plays as empty
+            const std::size_t length = samples.size() / 2;
+            const std::size_t count = std::min(frames - done, length - std::min(v.frame, length));
+
+            mixAccumulate(out + 2 * done, samples.data() + 2 * v.frame, v.gain, 2 * count);
+            done += count;
+            v.frame += count;
+
+            if (v.frame >= length) {
+                v.frame = 0;
+                v.playing = ++v.current < v.queue.size();
+            }
+        }
+    }
+}
+
+void mixAccumulate(float *out, const float *in, float gain, std::size_t count)
+{
+    std::size_t k = 0;
+#if defined(__AVX__)
+    const __m256 g8 = _mm256_set1_ps(gain);
+    for (; k + 16 <= count; k += 16) {
+        const __m256 a = _mm256_add_ps(_mm256_loadu_ps(out + k), _mm256_mul_ps(g8, _mm256_loadu_ps(in + k)));
+        const __m256 b = _mm256_add_ps(_mm256_loadu_ps(out + k + 8), _mm256_mul_ps(g8, _mm256_loadu_ps(in + k + 8)));
+        _mm256_storeu_ps(out + k, a);
+        _mm256_storeu_ps(out + k + 8, b);
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128 g4 = _mm_set1_ps(gain);
+    for (; k + 8 <= count; k += 8) {
+        const __m128 a = _mm_add_ps(_mm_loadu_ps(out + k), _mm_mul_ps(g4, _mm_loadu_ps(in + k)));
+        const __m128 b = _mm_add_ps(_mm_loadu_ps(out + k + 4), _mm_mul_ps(g4, _mm_loadu_ps(in + k + 4)));
+        _mm_storeu_ps(out + k, a);
+        _mm_storeu_ps(out + k + 4, b);
+    }
+#endif
+    for (; k < count; ++k)
+        out[k] += gain * in[k];
+}
+
+void floatToPcm16(const float *in, std::int16_t *out, std::size_t count)
+{
+    std::size_t k = 0;
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    const __m128 low = _mm_set1_ps(-1.0f), high = _mm_set1_ps(1.0f);
+    for (; k + 8 <= count; k += 8) {
+        const __m128 a = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + k), low), high), scale);
+        const __m128 b = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + k + 4), low), high), scale);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + k),
+                         _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+#endif
+    for (; k < count; ++k)
+        out[k] = std::int16_t(std::lrint(std::clamp(in[k], -1.0f, 1.0f) * 32767.0f));
+}
+
+// Canonical 44-byte header of 16-bit stereo PCM
+static void wavHeader(char *header, int rate, std::uint32_t bytes)
+{
+    auto put = [&header](std::size_t at, std::uint32_t value, std::size_t size) {
+        for (std::size_t k = 0; k < size; ++k)
+            header[at + k] = char(value >> (8 * k));
+    };
+
+    std::memcpy(header, "RIFF", 4);
+    put(4, 36 + bytes, 4);
+    std::memcpy(header + 8, "WAVEfmt ", 8);
+    put(16, 16, 4);
+    put(20, 1, 2);              // PCM
+    put(22, 2, 2);              // Channels
+    put(24, std::uint32_t(rate), 4);
+    put(28, std::uint32_t(rate) * 4, 4);
+    put(32, 4, 2);              // Bytes per frame
+    put(34, 16, 2);             // Bits per sample
+    std::memcpy(header + 36, "data", 4);
+    put(40, bytes, 4);
+}
+
+bool WavWriter::open(const std::string& path, int rate)
+{
+    m_out.open(path, std::ios::binary | std::ios::trunc);
+    m_bytes = 0;
+
+    char header[44];
+    wavHeader(header, rate, 0);
+    m_out.write(header, sizeof(header));
+    m_rate = rate;
+    return bool(m_out);
+}
+
+void WavWriter::write(const std::int16_t *samples, std::size_t frames)
+{
+    // Samples go out little-endian, as they are in memory on every target
+    m_out.write(reinterpret_cast<const char *>(samples), std::streamsize(frames * 4));
+    m_bytes += std::uint32_t(frames * 4);
+}
+
+bool WavWriter::close()
+{
+    if (not m_out.is_open())
+        return true;
+
+    char header[44];
+    wavHeader(header, m_rate, m_bytes);
+    m_out.seekp(0);
+    m_out.write(header, sizeof(header));
+    m_out.close();
+    return not m_out.fail();
+}
@@ -0,0 +1,92 @@
+#ifndef MIXER_HPP
+#define MIXER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Software audio output for machines without a sound device. Voices play
+// queues of buffers like OpenAL sources do, and render() sums them into
+// interleaved float stereo at the output rate. Not thread-safe.
+class Mixer {
+public:
+    enum class Format { Mono8, Mono16, Stereo8, Stereo16 };
+
+    explicit Mixer(int rate = 44100) : m_rate(rate) {}
+
+    int rate() const { return m_rate; }
+
+    // Names start at 1, 0 is none. Calls with a name that was never made
+    // do nothing and report 0 or false.
+    unsigned createBuffer();
+    void deleteBuffer(unsigned buffer);
+    // PCM is converted to float stereo at the output rate here, once
+    void bufferData(unsigned buffer, Format format, const void *data, std::size_t bytes, int rate);
+
+    unsigned createVoice();
+    void deleteVoice(unsigned voice);
+    void setGain(unsigned voice, float gain);
+    // Replaces the queue with this one buffer, or empties it for 0
+    void attach(unsigned voice, unsigned buffer);
+    void queue(unsigned voice, unsigned buffer);
+    // The oldest played-out buffer taken off the queue, 0 when none
+    unsigned unqueue(unsigned voice);
+    std::size_t processed(unsigned voice) const;
+    std::size_t queued(unsigned voice) const;
+
+    // From the head of the queue
+    void play(unsigned voice);
+    void stop(unsigned voice);
+    bool playing(unsigned voice) const;
+    // Whether any voice is
+    bool active() const;
+
+    // Overwrites frames * 2 floats of out with the sum of the playing voices
+    void render(float *out, std::size_t frames);
+
+private:
+    struct Buffer {
+        bool used = false;
+        std::vector<float> samples; // Stereo, at m_rate
+    };
+
+    struct Voice {
+        bool used = false;
+        bool playing = false;
+        float gain = 1.0f;
+        std::deque<unsigned> queue;
+        std::size_t current = 0; // Buffers of the queue played out
+        std::size_t frame = 0;   // Into the current one
+    };
+
+    bool hasBuffer(unsigned buffer) const { return buffer != 0 and buffer <= m_buffers.size(); }
+    bool hasVoice(unsigned voice) const { return voice != 0 and voice <= m_voices.size(); }
+
+    int m_rate;
+    std::vector<Buffer> m_buffers;
+    std::vector<Voice> m_voices;
+};
+
+// out[k] += gain * in[k]
+void mixAccumulate(float *out, const float *in, float gain, std::size_t count);
+// Clamps to [-1, 1] and scales to 16-bit PCM
+void floatToPcm16(const float *in, std::int16_t *out, std::size_t count);
+
+// 16-bit stereo WAV written as it comes, the sizes are filled in by close()
+class WavWriter {
+public:
+    bool open(const std::string& path, int rate);
+    void write(const std::int16_t *samples, std::size_t frames);
+    bool close();
+    ~WavWriter() { close(); }
+
+private:
+    std::ofstream m_out;
+    int m_rate = 0;
+    std::uint32_t m_bytes = 0;
+};
+
+#endif // MIXER_HPP
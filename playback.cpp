@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "map.hpp"
+#include "profiler.hpp"
+#include "replay.hpp"
+
+// Headless replay: plays recorded sessions through Map at full speed and
+// reports the latency of every move, so a session doubles as a benchmark.
+
+struct Options {
+    std::string path;
+    int repeat = 1; // Passes over the file
+    std::string trace; // Chrome trace of the Map calls
+};
+
+static void usage(const char *name)
+{
+    std::cerr << "Usage: " << name << " FILE [--repeat N] [--trace FILE]" << std::endl;
+}
+
+static bool parse(int argc, char **argv, Options& o)
+{
+    if (argc < 2 or argc % 2)
+        return false;
+
+    o.path = argv[1];
+    for (int k = 2; k + 1 < argc; k += 2) {
+        const char *arg = argv[k], *value = argv[k + 1];
+        if (not std::strcmp(arg, "--repeat"))
+            o.repeat = std::max(1, std::atoi(value));
+        else if (not std::strcmp(arg, "--trace"))
+            o.trace = value;
+        else {
+            std::cerr << "ERROR: unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    Options o;
+    if (not parse(argc, argv, o)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    using clock = std::chrono::steady_clock;
+    profiler::enable(not o.trace.empty());
+
+    std::vector<double> latency; // Nanoseconds a move
+    std::uint64_t games = 0, wins = 0, fails = 0, rejected = 0;
+    std::size_t bytes = 0;
+    double seconds = 0;
+
+    try {
+        for (int pass = 0; pass < o.repeat; ++pass) {
+            replay::Reader reader(o.path);
+            replay::Reader::Board board;
+            std::uint64_t token;
+            Map map;
+            bool started = false;
+
+            bytes += reader.size();
+            auto begin = clock::now();
+
+            while (reader.next(token, board)) {
+                if (token == replay::Token::board) {
+                    if (started) {
+                        wins += map.status() == Status::win;
+                        fails += map.status() == Status::fail;
+                    }
+                    map.generate(board.seed, board.settings);
+                    started = true;
+                    ++games;
+                    continue;
+                }
+
+                if (not started)
+                    throw std::runtime_error("Replay has moves before its first board.");
+
+                bool accepted;
+                auto move_begin = clock::now();
+                if (token == replay::Token::undo)
+                    accepted = map.undo();
+                else if (token == replay::Token::redo)
+                    accepted = map.redo();
+                else {
+                    const std::uint64_t tile = token - replay::Token::first_wall;
+                    if (tile >= map.width() * map.height())
+                        throw std::runtime_error("Replay has a wall outside the board.");
+                    accepted = map.setWall(Position{int(tile / map.width()), int(tile % map.width())});
+                }
+                latency.push_back(std::chrono::duration<double, std::nano>(clock::now() - move_begin).count());
+                rejected += not accepted;
+            }
+
+            if (started) {
+                wins += map.status() == Status::win;
+                fails += map.status() == Status::fail;
+            }
+            seconds += std::chrono::duration<double>(clock::now() - begin).count();
+        }
+    } catch (std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (not o.trace.empty() and not profiler::writeTrace(o.trace)) {
+        std::cerr << "ERROR: can't write " << o.trace << std::endl;
+        return 1;
+    }
+
+    if (latency.empty()) {
+        std::cout << "games:     " << games << "\nmoves:     0" << std::endl;
+        return 0;
+    }
+
+    const double total = [&]() { double t = 0; for (double l : latency) t += l; return t; }();
+    auto percentile = [&](double p) {
+        auto k = std::vector<double>::size_type(p * double(latency.size() - 1));
+        std::nth_element(latency.begin(), latency.begin() + k, latency.end());
+        return latency[k];
+    };
+
+    std::cout << "file:      " << o.path << ", " << bytes / o.repeat << " bytes, " << o.repeat << " passes\n"
+              << "games:     " << games << ", " << wins << " won, " << fails << " lost\n"
+              << "moves:     " << latency.size() << ", " << rejected << " rejected\n"
+              << "time:      " << seconds << " s\n"
+              << "moves/sec: " << double(latency.size()) / seconds << "\n"
+              << "latency:   mean " << total / double(latency.size())
+              << " ns, p50 " << percentile(0.50)
+              << " ns, p99 " << percentile(0.99)
+              << " ns, max " << percentile(1.0) << " ns" << std::endl;
+
+    return rejected ? 2 : 0;
+}
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "profiler.hpp"
+
+namespace profiler {
+
+namespace {
+
+struct Ring {
+    std::vector<Event> events = std::vector<Event>(ring_size);
+    std::atomic<std::uint64_t> written{0};
+    std::uint32_t track = 0;
+};
+
+const auto epoch = std::chrono::steady_clock::now();
+
+// Only touched when a thread records for the first time and when reading,
+// rings outlive their threads
+std::mutex registry_mutex;
+std::vector<std::shared_ptr<Ring>> registry;
+
+Ring& ring()
+{
+    thread_local std::shared_ptr<Ring> local;
+    if (not local) {
+        local = std::make_shared<Ring>();
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(local);
+        local->track = std::uint32_t(registry.size()); // gpu_track is 0
+    }
+    return *local;
+}
+
+void push(Ring& r, const Event& e)
+{
+    const std::uint64_t n = r.written.load(std::memory_order_relaxed);
+    r.events[n % ring_size] = e;
+    r.written.store(n + 1, std::memory_order_release);
+}
+
+}
+
+void enable(bool value)
+{
+    detail::on.store(value, std::memory_order_relaxed);
+}
+
+std::uint64_t now()
+{
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count());
+}
+
+void record(const char *name, std::uint64_t begin, std::uint64_t duration)
+{
+    Ring& r = ring();
+    push(r, Event{name, begin, duration, r.track});
+}
+
+void record(const char *name, std::uint64_t begin, std::uint64_t duration, std::uint32_t track)
+{
+    push(ring(), Event{name, begin, duration, track});
+}
+
+std::vector<Event> events()
+{
+    std::vector<Event> all;
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto &r : registry) {
+        const std::uint64_t written = r->written.load(std::memory_order_acquire);
+        const std::uint64_t first = written > ring_size ? written - ring_size : 0;
+        for (std::uint64_t n = first; n < written; ++n)
+            all.push_back(r->events[n % ring_size]);
+    }
+    return all;
+}
+
+bool writeTrace(const std::string& path)
+{
+    std::FILE *out = std::fopen(path.c_str(), "w");
+    if (not out)
+        return false;
+
+    std::vector<std::uint32_t> tracks = {gpu_track};
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (auto &r : registry)
+            tracks.push_back(r->track);
+    }
+
+    std::fprintf(out, "{\"traceEvents\":[\n");
+    for (auto track : tracks)
+        std::fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}},\n",
+                     track, track == gpu_track ? "GPU" : "thread", track);
+
+    // Trace times are in microseconds
+    for (auto &e : events())
+        std::fprintf(out, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f},\n",
+                     e.name, e.track, double(e.begin) / 1e3, double(e.duration) / 1e3);
+
+    std::fprintf(out, "{\"name\":\"end\",\"ph\":\"i\",\"pid\":1,\"tid\":0,\"ts\":%.3f,\"s\":\"g\"}\n]}\n", double(now()) / 1e3);
+    return std::fclose(out) == 0;
+}
+
+std::vector<Summary> summarize(std::uint64_t since)
+{
+    std::map<std::pair<std::uint32_t, const char *>, Summary> totals;
+    for (auto &e : events()) {
+        if (e.begin < since)
+            continue;
+
+        Summary &s = totals[{e.track, e.name}];
+        s.name = e.name;
+        s.track = e.track;
+        ++s.count;
+        s.total += e.duration;
+        s.max = std::max(s.max, e.duration);
+    }
+
+    std::vector<Summary> result;
+    for (auto &t : totals)
+        result.push_back(t.second);
+    return result;
+}
+
+}
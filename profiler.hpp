@@ -0,0 +1,77 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Scoped CPU timers and externally measured (GPU) spans. Every thread
+// writes into its own ring of the last ring_size events without locks;
+// writeTrace() dumps all rings as Chrome/Perfetto trace JSON. Disabled
+// until enable(true), when a scope costs one relaxed atomic load.
+namespace profiler {
+
+constexpr std::size_t ring_size = 1 << 16;
+constexpr std::uint32_t gpu_track = 0; // Track of the spans measured on the GPU
+
+struct Event {
+    const char *name;       // String literal, only the pointer is kept
+    std::uint64_t begin;    // Nanoseconds since the profiler started
+    std::uint64_t duration;
+    std::uint32_t track;    // gpu_track or the recording thread
+};
+
+namespace detail {
+inline std::atomic<bool> on{false};
+}
+
+void enable(bool on);
+
+inline bool enabled()
+{
+    return detail::on.load(std::memory_order_relaxed);
+}
+
+std::uint64_t now();
+
+// Into the calling thread's ring, on its own track unless one is given
+void record(const char *name, std::uint64_t begin, std::uint64_t duration);
+void record(const char *name, std::uint64_t begin, std::uint64_t duration, std::uint32_t track);
+
+// Events of every thread, oldest first per thread. A ring being written
+// while it's read may give back a torn copy of its oldest event.
+std::vector<Event> events();
+
+bool writeTrace(const std::string& path);
+
+struct Summary {
+    const char *name;
+    std::uint32_t track;
+    std::uint64_t count = 0;
+    std::uint64_t total = 0;
+    std::uint64_t max = 0;
+};
+
+// Totals by name of the events that began at or after `since`
+std::vector<Summary> summarize(std::uint64_t since);
+
+class Scope {
+public:
+    explicit Scope(const char *name) : m_name(enabled() ? name : nullptr), m_begin(m_name ? now() : 0) {}
+    ~Scope() {
+        if (m_name)
+            record(m_name, m_begin, now() - m_begin);
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const char *m_name;
+    std::uint64_t m_begin;
+};
+
+}
+
+#endif // PROFILER_HPP
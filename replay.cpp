@@ -0,0 +1,126 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "replay.hpp"
+
+#define REPLAY_MAGIC "CTCR"
+#define REPLAY_VERSION 1
+
+namespace replay {
+
+Writer::Writer(const std::string& path)
+{
+    if (not open(path))
+        throw std::runtime_error("Can't write replay " + path + ".");
+}
+
+Writer::~Writer()
+{
+    flush();
+}
+
+bool Writer::open(const std::string& path)
+{
+    m_out.open(path, std::ios::binary | std::ios::trunc);
+    if (not m_out)
+        return false;
+
+    m_out.write(REPLAY_MAGIC, 4);
+    m_out.put(char(REPLAY_VERSION));
+    return bool(m_out);
+}
+
+void Writer::board(const Map& map)
+{
+    const MapSettings& s = map.settings();
+    std::uint32_t density;
+    std::memcpy(&density, &s.wall_density, sizeof(density));
+
+    // Whatever was played before survives a crash in this game
+    flush();
+
+    put(Token::board);
+    put(std::uint64_t(s.width));
+    put(std::uint64_t(s.height));
+    put(std::uint64_t(s.min_escape_distance));
+    put(density);
+    put(map.seed());
+}
+
+void Writer::wall(int tile)
+{
+    put(Token::first_wall + std::uint64_t(tile));
+}
+
+void Writer::undo()
+{
+    put(Token::undo);
+}
+
+void Writer::redo()
+{
+    put(Token::redo);
+}
+
+void Writer::flush()
+{
+    if (isOpen())
+        m_out.flush();
+}
+
+void Writer::put(std::uint64_t value)
+{
+    if (not isOpen())
+        return;
+
+    // Seven bits a byte, low first, the high bit set on all but the last
+    while (value >= 0x80) {
+        m_out.put(char(value | 0x80));
+        value >>= 7;
+    }
+    m_out.put(char(value));
+}
+
+Reader::Reader(const std::string& path) : m_file(path)
+{
+    m_data = m_file.data();
+    m_size = m_file.size();
+
+    if (m_size < 5 or std::memcmp(m_data, REPLAY_MAGIC, 4) != 0 or m_data[4] != REPLAY_VERSION)
+        throw std::runtime_error("Replay " + path + " has an unknown format.");
+    m_at = 5;
+}
+
+bool Reader::next(std::uint64_t& token, Board& board)
+{
+    if (m_at >= m_size)
+        return false;
+
+    token = get();
+    if (token == Token::board) {
+        board.settings.width = int(get());
+        board.settings.height = int(get());
+        board.settings.min_escape_distance = int(get());
+        const std::uint32_t density = std::uint32_t(get());
+        std::memcpy(&board.settings.wall_density, &density, sizeof(density));
+        board.seed = get();
+    }
+    return true;
+}
+
+std::uint64_t Reader::get()
+{
+    std::uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (m_at >= m_size)
+            throw std::runtime_error("Replay ends in the middle of a value.");
+
+        const unsigned char byte = m_data[m_at++];
+        value |= std::uint64_t(byte & 0x7f) << shift;
+        if (not (byte & 0x80))
+            return value;
+    }
+    throw std::runtime_error("Replay has a value longer than 64 bits.");
+}
+
+}
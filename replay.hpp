@@ -0,0 +1,81 @@
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#include "map.hpp"
+#include "mapped_file.hpp"
+
+// Recorded sessions: a "CTCR" magic and a version byte, then a stream of
+// LEB128 varints. Each token is one of
+//
+//   0  undo
+//   1  redo
+//   2  new board: width, height, minimum escape distance, the bits of the
+//      wall density and the seed follow, one varint each
+//   3+ wall on tile i * width + j = token - 3
+//
+// so a wall costs one byte on boards of up to 125 tiles (11x11 has 121),
+// and two bytes on boards of up to 16381 tiles (127x127 has 16129).
+namespace replay {
+
+enum Token : std::uint64_t {
+    undo = 0,
+    redo = 1,
+    board = 2,
+    first_wall = 3
+};
+
+class Writer {
+public:
+    Writer() = default;
+    explicit Writer(const std::string& path);
+    ~Writer();
+
+    bool open(const std::string& path);
+    bool isOpen() const { return m_out.is_open(); }
+
+    // Starts a new game on the map's board, as it is right after generate()
+    void board(const Map& map);
+    void wall(int tile);
+    void undo();
+    void redo();
+
+    void flush();
+
+private:
+    std::ofstream m_out;
+
+    void put(std::uint64_t value);
+};
+
+// A recorded file mapped read-only into memory, decoded in place
+class Reader {
+public:
+    struct Board {
+        MapSettings settings;
+        std::uint64_t seed = 0;
+    };
+
+    explicit Reader(const std::string& path);
+
+    std::size_t size() const { return m_size; }
+
+    // Next token, false at the end of the file. A board token fills `board`.
+    bool next(std::uint64_t& token, Board& board);
+
+private:
+    MappedFile m_file;
+    const unsigned char *m_data = nullptr;
+    std::size_t m_size = 0;
+    std::size_t m_at = 0;
+
+    std::uint64_t get();
+};
+
+}
+
+#endif // REPLAY_HPP
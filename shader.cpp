@@ -1,47 +1,91 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cstring>
+#include <vector>
 
 #include "util.hpp"
-#include "Shader.h"
+#include "mapped_file.hpp"
+#include "profiler.hpp"
+#include "shader.hpp"
 
-Program::Program(const GLchar* vertexPath, const GLchar* fragmentPath) {
-    // 1. Получаем исходный код шейдера из filePath
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
+#define PROGRAM_CACHE_MAGIC "CTCP"
+#define PROGRAM_CACHE_VERSION 1
 
+// Program cache layout: this header, then `length` bytes of the binary
+struct ProgramCacheHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t key;    // Sources and driver the binary was built from
+    std::uint32_t format; // As glGetProgramBinary reported it
+    std::uint32_t length;
+};
+
+// FNV-1a over the sources and the driver strings, a new driver or a changed
+// shader gives a new key
+static std::uint64_t programKey(const std::string& vertex, const std::string& fragment)
+{
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    auto add = [&hash](const char *data, std::size_t size) {
+        for (std::size_t k = 0; k < size; ++k)
+            hash = (hash ^ (unsigned char)data[k]) * 0x100000001b3ull;
+        hash = (hash ^ 0xff) * 0x100000001b3ull; // Keeps "ab" + "c" apart from "a" + "bc"
+    };
+
+    add(vertex.data(), vertex.size());
+    add(fragment.data(), fragment.size());
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        const char *value = reinterpret_cast<const char *>(glGetString(name));
+        add(value ? value : "", value ? std::strlen(value) : 0);
+    }
+    return hash;
+}
+
+GLuint Program::current = 0;
+
+std::string Program::readSource(const GLchar* path) {
+    std::ifstream file;
     // Удостоверимся, что ifstream объекты могут выкидывать исключения
-    vShaderFile.exceptions(std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::badbit);
+    file.exceptions(std::ifstream::badbit);
     try
     {
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        std::stringstream vShaderStream, fShaderStream;
+        file.open(path);
+        std::stringstream stream;
+        stream << file.rdbuf();
+        return stream.str();
+    } catch(std::ifstream::failure& e) {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+    }
+    return std::string();
+}
 
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
+Program::Program(const GLchar* vertexPath, const GLchar* fragmentPath)
+    : Program(readSource(vertexPath), readSource(fragmentPath), vertexPath) {}
 
-        vShaderFile.close();
-        fShaderFile.close();
+Program::Program(const std::string& vertexCode, const std::string& fragmentCode, const GLchar* vertexPath) {
+    this->program = glCreateProgram();
 
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
-    } catch(std::ifstream::failure e) {
-        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+    // Warm runs load the linked program the driver handed out last time
+    const bool cacheable = GLEW_ARB_get_program_binary;
+    const std::string cachePath = std::string(vertexPath) + ".program";
+    const std::uint64_t key = cacheable ? programKey(vertexCode, fragmentCode) : 0;
+    if (cacheable and loadBinary(cachePath, key)) {
+        reflectUniforms();
+        return;
     }
 
+    profiler::Scope scope("compile shaders");
+
     const GLchar *vertexShaderSource = vertexCode.c_str();
     const GLchar *fragmentShaderSource = fragmentCode.c_str();
 
     Shader fragmentShader(GL_VERTEX_SHADER, vertexShaderSource),
            vertexShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
 
-    this->program = glCreateProgram();
     glAttachShader(this->program, vertexShader.id());
     glAttachShader(this->program, fragmentShader.id());
+    if (cacheable)
+        glProgramParameteri(this->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(this->program);
 
 //    LOG(vertexShaderSource);
@@ -53,6 +97,80 @@ Program::Program(const GLchar* vertexPath, const GLchar* fragmentPath) {
     if (!success) {
         glGetProgramInfoLog(this->program, 512, nullptr, infoLog);
             std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    } else if (cacheable) {
+        saveBinary(cachePath, key);
+    }
+
+    reflectUniforms();
+}
+
+bool Program::loadBinary(const std::string& path, std::uint64_t key) {
+    profiler::Scope scope("load program binary");
+
+    try {
+        MappedFile file(path);
+
+        ProgramCacheHeader header;
+        if (file.size() < sizeof(header))
+            return false;
+        std::memcpy(&header, file.data(), sizeof(header));
+
+        if (std::memcmp(header.magic, PROGRAM_CACHE_MAGIC, 4) != 0 or header.version != PROGRAM_CACHE_VERSION or
+            header.key != key or file.size() != sizeof(header) + header.length)
+            return false;
+
+        glProgramBinary(this->program, header.format, file.data() + sizeof(header), GLsizei(header.length));
+    } catch (std::runtime_error&) {
+        return false;
+    }
+
+    // The driver may still refuse a binary it made itself, after an update
+    GLint success = 0;
+    glGetProgramiv(this->program, GL_LINK_STATUS, &success);
+    return success;
+}
+
+void Program::saveBinary(const std::string& path, std::uint64_t key) {
+    GLint length = 0;
+    glGetProgramiv(this->program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(this->program, length, &length, &format, binary.data());
+
+    ProgramCacheHeader header = {};
+    std::memcpy(header.magic, PROGRAM_CACHE_MAGIC, 4);
+    header.version = PROGRAM_CACHE_VERSION;
+    header.key = key;
+    header.format = format;
+    header.length = std::uint32_t(length);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(binary.data(), length);
+    if (not out.flush())
+        std::cout << "WARNING::SHADER::PROGRAM::CACHE_NOT_WRITTEN " << path << std::endl;
+}
+
+void Program::reflectUniforms() {
+    GLint count = 0;
+    glGetProgramiv(this->program, GL_ACTIVE_UNIFORMS, &count);
+
+    for (GLint k = 0; k < count; ++k) {
+        GLchar name[256];
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(this->program, GLuint(k), sizeof(name), &length, &size, &type, name);
+
+        // Arrays are reported as "name[0]", set through their first element
+        std::string key(name, length);
+        if (key.size() > 3 and key.compare(key.size() - 3, 3, "[0]") == 0)
+            key.resize(key.size() - 3);
+
+        uniforms[key] = ActiveUniform{glGetUniformLocation(this->program, name), type};
     }
 }
 
@@ -69,6 +187,13 @@ bool Program::Shader::checkCompilation(GLuint shaderProgram) {
     return success;
 }
 
-void Program::use() const {
+void Program::use() {
+    if (current == this->program)
+        return;
+
     glUseProgram(this->program);
+    current = this->program;
+#ifdef UNIFORM_STATS
+    ++stats.binds;
+#endif
 }
@@ -5,7 +5,12 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <cstdint>
+#include <iostream>
 #include <string>
+#include <unordered_map>
+
+#include "util.hpp"
 
 class Program {
     GLuint program;
@@ -29,50 +34,109 @@ public:
         }
     };
 
-    void setUniform(const char* name, float value) {
-        GLint uniformId = glGetUniformLocation(this->program, name);
+    // Resolved once, then set without a lookup by name. A handle of a
+    // uniform the program doesn't have, or has with another type, is
+    // invalid and setting it does nothing.
+    template <class T>
+    class Uniform {
+        friend class Program;
+        GLint location = -1;
+    public:
+        bool valid() const { return location >= 0; }
+    };
 
-        glUseProgram(this->program);
-        glUniform1f(uniformId, value);
+    template <class T>
+    Uniform<T> uniform(const char* name) const {
+        Uniform<T> handle;
+        auto found = uniforms.find(name);
+        if (found == uniforms.end())
+            std::cout << "ERROR::SHADER::UNIFORM::NOT_ACTIVE " << name << std::endl;
+        else if (not accepts<T>(found->second.type))
+            std::cout << "ERROR::SHADER::UNIFORM::TYPE_MISMATCH " << name << std::endl;
+        else
+            handle.location = found->second.location;
+        return handle;
     }
-    void setUniform(const char* name, const glm::mat4x4& mat) {
-        GLint uniformId = glGetUniformLocation(this->program, name);
 
-        glUseProgram(this->program);
-        glUniformMatrix4fv(uniformId, 1, GL_FALSE, glm::value_ptr(mat));
-    }
+    template <class T>
+    void set(Uniform<T> handle, const T& value) {
+        if (not handle.valid())
+            return;
 
-    void setUniform(const char* name, int value) {
-        GLint uniformId = glGetUniformLocation(this->program, name);
+        use();
+        upload(handle.location, value);
+#ifdef UNIFORM_STATS
+        ++stats.updates;
+#endif
+    }
 
-        glUseProgram(this->program);
-        glUniform1i(uniformId, value);
+    // Resolves the name on every call, for uniforms set once
+    template <class T>
+    void setUniform(const char* name, const T& value) {
+        set(uniform<T>(name), value);
     }
 
-    void setUniform(const char* name, const glm::vec3& vec) {
-        GLint uniformId = glGetUniformLocation(this->program, name);
+#ifdef UNIFORM_STATS
+    struct Stats {
+        unsigned long updates = 0; // Uniform values uploaded
+        unsigned long binds = 0;   // glUseProgram calls
+    };
 
-        glUseProgram(this->program);
-        glUniform3fv(uniformId, 1, glm::value_ptr(vec));
+    // Counters since the last call
+    Stats takeStats() {
+        Stats taken = stats;
+        stats = Stats();
+        return taken;
     }
+#endif
 
-    void setUniform(const char* name, bool vec) {
-        GLint uniformId = glGetUniformLocation(this->program, name);
+    Program(const GLchar* vectorPath, const GLchar* fragmentPath);
+    // From sources read ahead of time; vertexPath only names the binary cache
+    Program(const std::string& vertexCode, const std::string& fragmentCode, const GLchar* vertexPath);
+    // Plain file read, safe off the GL thread
+    static std::string readSource(const GLchar* path);
 
-        glUseProgram(this->program);
-        glUniform1i(uniformId, vec);
-    }
+    void use();
+    GLuint get() const { return this->program; }
 
-//    void setUniform(const char* name, unsigned char* value) {
-//        GLint uniformId = glGetUniformLocation(this->program, name);
+private:
+    struct ActiveUniform {
+        GLint location;
+        GLenum type;
+    };
 
-//        glUseProgram(this->program);
-//        glUniform(uniformId, value);
-//    }
+    std::unordered_map<std::string, ActiveUniform> uniforms;
+    static GLuint current; // Program bound by the last use()
+#ifdef UNIFORM_STATS
+    Stats stats;
+#endif
 
-    Program(const GLchar* vectorPath, const GLchar* fragmentPath);
-    void use() const;
-    GLuint get() const { return this->program; }
+    void reflectUniforms();
+
+    // Linked program binaries kept in `path`, valid for one key only
+    bool loadBinary(const std::string& path, std::uint64_t key);
+    void saveBinary(const std::string& path, std::uint64_t key);
+
+    template <class T>
+    static bool accepts(GLenum type);
+
+    static void upload(GLint location, float value) { glUniform1f(location, value); }
+    static void upload(GLint location, int value) { glUniform1i(location, value); }
+    static void upload(GLint location, bool value) { glUniform1i(location, value); }
+    static void upload(GLint location, const glm::vec2& vec) { glUniform2fv(location, 1, glm::value_ptr(vec)); }
+    static void upload(GLint location, const glm::vec3& vec) { glUniform3fv(location, 1, glm::value_ptr(vec)); }
+    static void upload(GLint location, const glm::mat4x4& mat) { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mat)); }
 };
 
+template <> inline bool Program::accepts<float>(GLenum type) { return type == GL_FLOAT; }
+template <> inline bool Program::accepts<bool>(GLenum type) { return type == GL_BOOL; }
+template <> inline bool Program::accepts<glm::vec2>(GLenum type) { return type == GL_FLOAT_VEC2; }
+template <> inline bool Program::accepts<glm::vec3>(GLenum type) { return type == GL_FLOAT_VEC3; }
+template <> inline bool Program::accepts<glm::mat4x4>(GLenum type) { return type == GL_FLOAT_MAT4; }
+
+// Samplers are set by texture unit
+template <> inline bool Program::accepts<int>(GLenum type) {
+    return type == GL_INT or type == GL_SAMPLER_2D;
+}
+
 #endif // SHADER_HPP
@@ -0,0 +1,349 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "generator.hpp"
+#include "map.hpp"
+#include "replay.hpp"
+#include "rng.hpp"
+#include "solver.hpp"
+
+// Headless self-play: plays seeded games with a chosen player strategy on
+// every core and reports throughput and win rates.
+
+class Player {
+public:
+    virtual ~Player() = default;
+    virtual Position move(const Map& map, Rng& random) = 0;
+};
+
+// Any free tile
+class RandomPlayer : public Player {
+public:
+    Position move(const Map& map, Rng& random) override {
+        for (;;) {
+            Position p = {int(random.below(map.height())), int(random.below(map.width()))};
+            if (map.type(p) == HexType::regular)
+                return p;
+        }
+    }
+};
+
+// Walls the cat's free neighbour nearest to the border. The cat only picks
+// its step once the wall stands, so this is its best way out, not its move.
+class GreedyPlayer : public Player {
+public:
+    Position move(const Map& map, Rng& random) override {
+        const Position c = map.cat();
+        const Position neighbors_positions[6] = {
+            {c.i+1, c.j - (c.i&1)}, {c.i+1, c.j+1 - (c.i&1)},
+            {c.i, c.j-1}, {c.i, c.j+1},
+            {c.i-1, c.j - (c.i&1)}, {c.i-1, c.j+1 - (c.i&1)}
+        };
+
+        Position best = {-1, -1};
+        int best_distance = Map::unreachable;
+        for (auto &n : neighbors_positions)
+            if (map.within(n) and map.type(n) == HexType::regular and map.distance(n) < best_distance) {
+                best = n;
+                best_distance = map.distance(n);
+            }
+
+        if (best.i < 0)
+            return RandomPlayer().move(map, random);
+        return best;
+    }
+};
+
+// Follows a proven win when the solver finds one within `depth` walls
+class SolverPlayer : public Player {
+    Solver m_solver;
+    int m_depth;
+    GreedyPlayer m_fallback;
+
+public:
+    explicit SolverPlayer(int depth) : m_solver(1, 18), m_depth(depth) {}
+
+    Position move(const Map& map, Rng& random) override {
+        Solver::Result result = m_solver.solve(map, m_depth);
+        if (result.outcome == Solver::Outcome::win and result.moves > 0)
+            return result.wall;
+        return m_fallback.move(map, random);
+    }
+};
+
+struct Options {
+    std::uint64_t games = 100000;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::uint64_t seed = 1;
+    std::string player = "greedy";
+    int depth = 3;
+    std::uint64_t boards = 0; // Only generate this many boards, no games
+    std::string record;       // Replay file of every game, played on one thread
+    std::string snapshot;     // Only save and load the first board, no games
+    MapSettings map;
+};
+
+struct Totals {
+    std::atomic<std::uint64_t> wins{0};
+    std::atomic<std::uint64_t> fails{0};
+    std::atomic<std::uint64_t> stuck{0};
+    std::atomic<std::uint64_t> moves{0};
+};
+
+using PlayerFactory = std::function<std::unique_ptr<Player>(const Options&)>;
+
+static const std::map<std::string, PlayerFactory> players = {
+    {"random", [](const Options&) { return std::make_unique<RandomPlayer>(); }},
+    {"greedy", [](const Options&) { return std::make_unique<GreedyPlayer>(); }},
+    {"solver", [](const Options& o) { return std::make_unique<SolverPlayer>(o.depth); }},
+};
+
+static void usage(const char *name)
+{
+    std::cerr << "Usage: " << name << " [--games N] [--threads N] [--seed N] [--player";
+    for (auto &p : players)
+        std::cerr << " " << p.first;
+    std::cerr << "] [--depth N] [--width N] [--height N] [--density D] [--boards N] [--record FILE] [--snapshot FILE]" << std::endl;
+}
+
+static bool parse(int argc, char **argv, Options& o)
+{
+    for (int k = 1; k < argc; ++k) {
+        const char *arg = argv[k];
+        const char *value = k + 1 < argc ? argv[k + 1] : nullptr;
+
+        if (not std::strcmp(arg, "--help"))
+            return false;
+        if (not value) {
+            std::cerr << "ERROR: missing value for " << arg << std::endl;
+            return false;
+        }
+
+        if (not std::strcmp(arg, "--games"))
+            o.games = std::strtoull(value, nullptr, 10);
+        else if (not std::strcmp(arg, "--threads"))
+            o.threads = std::max(1ul, std::strtoul(value, nullptr, 10));
+        else if (not std::strcmp(arg, "--seed"))
+            o.seed = std::strtoull(value, nullptr, 10);
+        else if (not std::strcmp(arg, "--player"))
+            o.player = value;
+        else if (not std::strcmp(arg, "--depth"))
+            o.depth = std::atoi(value);
+        else if (not std::strcmp(arg, "--width"))
+            o.map.width = std::atoi(value);
+        else if (not std::strcmp(arg, "--height"))
+            o.map.height = std::atoi(value);
+        else if (not std::strcmp(arg, "--density"))
+            o.map.wall_density = std::atof(value);
+        else if (not std::strcmp(arg, "--boards"))
+            o.boards = std::strtoull(value, nullptr, 10);
+        else if (not std::strcmp(arg, "--record"))
+            o.record = value;
+        else if (not std::strcmp(arg, "--snapshot"))
+            o.snapshot = value;
+        else {
+            std::cerr << "ERROR: unknown option " << arg << std::endl;
+            return false;
+        }
+        ++k;
+    }
+
+    if (not players.count(o.player)) {
+        std::cerr << "ERROR: unknown player " << o.player << std::endl;
+        return false;
+    }
+    if (o.games == 0) {
+        std::cerr << "ERROR: --games needs at least one game" << std::endl;
+        return false;
+    }
+
+    // One writer keeps the games in order
+    if (not o.record.empty())
+        o.threads = 1;
+
+    try {
+        o.map.validate();
+    } catch (std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// A board that can't be drawn stops every thread, `error` keeps its exception
+static void play(const Options& o, std::atomic<std::uint64_t>& next, Totals& totals, replay::Writer *recorder,
+                 std::exception_ptr& error)
+{
+    auto player = players.at(o.player)(o);
+    std::uint64_t wins = 0, fails = 0, stuck = 0, moves = 0;
+    Map map;
+    Rng random;
+
+    try {
+        for (std::uint64_t game; (game = next.fetch_add(1)) < o.games;) {
+            // Every game has its own board of the stream, so any one of them can be replayed alone
+            const std::uint64_t seed = boardSeed(o.seed, game);
+            random.reseed(seed ^ 0x5851f42d4c957f2dull);
+            map.generate(seed, o.map);
+            if (recorder)
+                recorder->board(map);
+
+            const auto limit = map.width() * map.height();
+            for (decltype(map.width()) turn = 0; map.status() == Status::playing and turn < limit; ++turn) {
+                if (not map.setWall(player->move(map, random)))
+                    break;
+                if (recorder)
+                    recorder->wall(map.journal().back().wall);
+                ++moves;
+            }
+
+            switch (map.status()) {
+            case Status::win: ++wins; break;
+            case Status::fail: ++fails; break;
+            case Status::playing: ++stuck; break;
+            }
+        }
+    } catch (...) {
+        error = std::current_exception();
+        next.store(o.games);
+    }
+
+    totals.wins += wins;
+    totals.fails += fails;
+    totals.stuck += stuck;
+    totals.moves += moves;
+}
+
+// Boards per second of generateBoards, in batches that stay in cache
+static bool generateOnly(const Options& o)
+{
+    const std::size_t batch = 1 << 14;
+    std::vector<Map> maps;
+    std::uint64_t escape = 0;
+
+    auto begin = std::chrono::steady_clock::now();
+
+    try {
+        for (std::uint64_t first = 0; first < o.boards; first += batch) {
+            const std::size_t count = std::size_t(std::min<std::uint64_t>(batch, o.boards - first));
+            generateBoards(maps, count, o.seed, first, o.map, o.threads);
+            for (auto &m : maps)
+                escape += m.distance(m.cat());
+        }
+    } catch (std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return false;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::cout << "board:      " << o.map.width << "x" << o.map.height << ", " << o.map.wall_density << " walls\n"
+              << "boards:     " << o.boards << " on " << o.threads << " threads\n"
+              << "time:       " << seconds << " s\n"
+              << "boards/sec: " << double(o.boards) / seconds << "\n"
+              << "escape:     " << double(escape) / double(o.boards) << " steps on average" << std::endl;
+    return true;
+}
+
+// Times drawing the first board of the stream against saving and loading it
+static bool snapshotOnly(const Options& o)
+{
+    using clock = std::chrono::steady_clock;
+    auto since = [](clock::time_point begin) { return std::chrono::duration<double>(clock::now() - begin).count(); };
+
+    try {
+        auto begin = clock::now();
+        Map map(boardSeed(o.seed, 0), o.map);
+        const double generate = since(begin);
+
+        begin = clock::now();
+        map.save(o.snapshot);
+        const double save = since(begin);
+
+        Map loaded;
+        begin = clock::now();
+        loaded.load(o.snapshot);
+        const double load = since(begin);
+
+        std::cout << "board:      " << o.map.width << "x" << o.map.height << ", " << o.map.wall_density << " walls\n"
+                  << "generate:   " << generate << " s\n"
+                  << "save:       " << save << " s\n"
+                  << "load:       " << load << " s" << std::endl;
+    } catch (std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    Options o;
+    if (not parse(argc, argv, o)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (o.boards)
+        return generateOnly(o) ? 0 : 1;
+
+    if (not o.snapshot.empty())
+        return snapshotOnly(o) ? 0 : 1;
+
+    Totals totals;
+    std::atomic<std::uint64_t> next{0};
+
+    std::unique_ptr<replay::Writer> recorder;
+    if (not o.record.empty()) {
+        recorder = std::make_unique<replay::Writer>();
+        if (not recorder->open(o.record)) {
+            std::cerr << "ERROR: can't write " << o.record << std::endl;
+            return 1;
+        }
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+
+    std::vector<std::exception_ptr> errors(o.threads);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < o.threads; ++t)
+        threads.emplace_back(play, std::cref(o), std::ref(next), std::ref(totals), recorder.get(), std::ref(errors[t]));
+    for (auto &t : threads)
+        t.join();
+
+    for (auto &error : errors)
+        if (error) {
+            try {
+                std::rethrow_exception(error);
+            } catch (std::exception& e) {
+                std::cerr << "ERROR: " << e.what() << std::endl;
+            }
+            return 1;
+        }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    double games = double(o.games);
+
+    std::cout << "player:    " << o.player << "\n"
+              << "board:     " << o.map.width << "x" << o.map.height << ", " << o.map.wall_density << " walls\n"
+              << "games:     " << o.games << " on " << o.threads << " threads\n"
+              << "time:      " << seconds << " s\n"
+              << "games/sec: " << games / seconds << "\n"
+              << "wins:      " << 100.0 * totals.wins / games << " %\n"
+              << "fails:     " << 100.0 * totals.fails / games << " %\n"
+              << "stuck:     " << 100.0 * totals.stuck / games << " %\n"
+              << "moves:     " << totals.moves / games << " per game\n"
+              << "tile:      " << Map::tile_state_bytes << " state + " << Map::tile_distance_bytes << " distance bytes"
+              << " (was " << Map::legacy_tile_bytes << " per HexTile)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#include "mapped_file.hpp"
+#include "map.hpp"
+#include "profiler.hpp"
+
+#define SNAPSHOT_MAGIC "CTCS"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+// Snapshot layout: this header, then the tile types, options, distances,
+// wall rows and final rows, each section starting on an 8-byte boundary so
+// the distances and rows can be read in place
+struct SnapshotHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t byte_order; // Snapshots are only read on machines of the same order
+    std::int32_t width, height;
+    std::int32_t words;       // BitBoard words a row
+    std::int32_t cat_i, cat_j;
+    std::int32_t status;
+    std::int32_t min_escape_distance;
+    float wall_density;
+    std::uint32_t reserved;
+    std::uint64_t seed;
+};
+
+static_assert(sizeof(SnapshotHeader) % 8 == 0);
+
+static std::size_t aligned(std::size_t bytes)
+{
+    return (bytes + 7) & ~std::size_t(7);
+}
+
+// Offsets of the sections, the last one is the file size
+struct SnapshotSections {
+    std::size_t types, opts, distance, walls, finals, end;
+
+    SnapshotSections(std::size_t tiles, std::size_t rows) {
+        types = sizeof(SnapshotHeader);
+        opts = types + aligned(tiles * sizeof(HexType));
+        distance = opts + aligned(tiles * sizeof(opt_t));
+        walls = distance + aligned(tiles * sizeof(int));
+        finals = walls + rows * sizeof(BitBoard::Word);
+        end = finals + rows * sizeof(BitBoard::Word);
+    }
+};
+
+// Whether every tile holds a known type, the cat sits only at `cat`, and
+// the bit rows agree with the tile arrays
+static bool tilesConsistent(int w, int h, Position cat, const std::uint8_t *types, const opt_t *opts,
+                            const BitBoard& board)
+{
+    for (int i = 0; i < h; ++i)
+        for (int j = 0; j < w; ++j) {
+            const int k = i * w + j;
+            if (types[k] > std::uint8_t(HexType::cat) or
+                (types[k] == std::uint8_t(HexType::cat)) != (i == cat.i and j == cat.j) or
+                (types[k] == std::uint8_t(HexType::wall)) != board.wall(i, j) or
+                bool(opts[k] & Option::final) != board.final(i, j))
+                return false;
+        }
+    return true;
+}
+
+// Whether `distance` is the distance field of the board. Finals are 0, walls
+// unreachable, and every other tile one more than its closest neighbour.
+// Only the true field satisfies this everywhere, so a field that passes has
+// a descending way out of every reachable tile.
+static bool distancesConsistent(int w, int h, const std::uint8_t *types, const opt_t *opts, const int *distance)
+{
+    for (int i = 0; i < h; ++i) {
+        const int odd = i & 1;
+        const int *row = distance + std::size_t(i) * w;
+        const int *above = i > 0 ? row - w : nullptr;
+        const int *below = i + 1 < h ? row + w : nullptr;
+
+        for (int j = 0; j < w; ++j) {
+            const std::size_t k = std::size_t(i) * w + j;
+            if (types[k] == std::uint8_t(HexType::wall)) {
+                if (row[j] != Map::unreachable)
+                    return false;
+                continue;
+            }
+            if (opts[k] & Option::final) {
+                if (row[j] != 0)
+                    return false;
+                continue;
+            }
+
+            // Same neighbours as Map::neighbors
+            int closest = Map::unreachable;
+            if (j > 0)
+                closest = std::min(closest, row[j - 1]);
+            if (j + 1 < w)
+                closest = std::min(closest, row[j + 1]);
+            for (const int *next : {above, below}) {
+                if (not next)
+                    continue;
+                if (j - odd >= 0)
+                    closest = std::min(closest, next[j - odd]);
+                if (j + 1 - odd < w)
+                    closest = std::min(closest, next[j + 1 - odd]);
+            }
+            if (row[j] != (closest == Map::unreachable ? Map::unreachable : closest + 1))
+                return false;
+        }
+    }
+    return true;
+}
+
+void Map::save(const std::string& path) const
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (not out)
+        throw std::runtime_error("Can't write snapshot " + path + ".");
+
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, 4);
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.width = m_width;
+    header.height = m_height;
+    header.words = m_board.words();
+    header.cat_i = m_cat.i;
+    header.cat_j = m_cat.j;
+    header.status = std::int32_t(m_status);
+    header.min_escape_distance = m_settings.min_escape_distance;
+    header.wall_density = m_settings.wall_density;
+    header.seed = m_seed;
+
+    const std::size_t tiles = m_types.size();
+
+    auto write = [&out](const void *data, std::size_t bytes) {
+        out.write(static_cast<const char *>(data), std::streamsize(bytes));
+    };
+    auto pad = [&out](std::size_t bytes) {
+        static const char zeros[8] = {};
+        out.write(zeros, std::streamsize(aligned(bytes) - bytes));
+    };
+
+    write(&header, sizeof(header));
+    write(m_types.data(), tiles * sizeof(HexType));
+    pad(tiles * sizeof(HexType));
+
+    // The tile under the cursor is not part of the board
+    if (m_hover < 0)
+        write(m_opts.data(), tiles * sizeof(opt_t));
+    else {
+        const opt_t hover = m_opts[m_hover] & ~Option::selected;
+        write(m_opts.data(), std::size_t(m_hover));
+        write(&hover, 1);
+        write(m_opts.data() + m_hover + 1, tiles - std::size_t(m_hover) - 1);
+    }
+    pad(tiles * sizeof(opt_t));
+
+    write(m_distance.data(), tiles * sizeof(int));
+    pad(tiles * sizeof(int));
+    write(m_board.walls().data(), m_board.walls().size() * sizeof(BitBoard::Word));
+    write(m_board.finals().data(), m_board.finals().size() * sizeof(BitBoard::Word));
+
+    if (not out.flush())
+        throw std::runtime_error("Can't write snapshot " + path + ".");
+}
+
+void Map::load(const std::string& path)
+{
+    profiler::Scope scope("Map::load");
+
+    MappedFile file(path);
+
+    SnapshotHeader header;
+    if (file.size() < sizeof(header))
+        throw std::runtime_error("Snapshot " + path + " is too short.");
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, 4) != 0 or header.version != SNAPSHOT_VERSION)
+        throw std::runtime_error("Snapshot " + path + " has an unknown format.");
+    if (header.byte_order != SNAPSHOT_BYTE_ORDER)
+        throw std::runtime_error("Snapshot " + path + " was saved with another byte order.");
+    if (header.width < 3 or header.height < 3 or header.words != (header.width + BitBoard::word_bits - 1) / BitBoard::word_bits)
+        throw std::runtime_error("Snapshot " + path + " has a broken board size.");
+
+    const std::size_t tiles = std::size_t(header.width) * std::size_t(header.height);
+    const SnapshotSections sections(tiles, std::size_t(header.words) * std::size_t(header.height));
+    if (file.size() != sections.end)
+        throw std::runtime_error("Snapshot " + path + " does not match its board size.");
+
+    const Position cat = {header.cat_i, header.cat_j};
+    if (cat.i < 0 or cat.i >= header.height or cat.j < 0 or cat.j >= header.width or
+        header.status < int(Status::playing) or header.status > int(Status::fail))
+        throw std::runtime_error("Snapshot " + path + " has a broken cat or status.");
+
+    const unsigned char *data = file.data();
+    auto types = reinterpret_cast<const std::uint8_t *>(data + sections.types);
+    auto opts = reinterpret_cast<const opt_t *>(data + sections.opts);
+    auto distance = reinterpret_cast<const int *>(data + sections.distance);
+
+    // Checked before anything is replaced, a broken file leaves the board as it was
+    BitBoard board;
+    board.assign(header.width, header.height,
+                 reinterpret_cast<const BitBoard::Word *>(data + sections.walls),
+                 reinterpret_cast<const BitBoard::Word *>(data + sections.finals));
+    if (not tilesConsistent(header.width, header.height, cat, types, opts, board))
+        throw std::runtime_error("Snapshot " + path + " has broken tiles.");
+    if (not distancesConsistent(header.width, header.height, types, opts, distance))
+        throw std::runtime_error("Snapshot " + path + " has broken distances.");
+
+    m_settings.width = header.width;
+    m_settings.height = header.height;
+    m_settings.wall_density = header.wall_density;
+    m_settings.min_escape_distance = header.min_escape_distance;
+    m_seed = header.seed;
+
+    m_width = header.width;
+    m_height = header.height;
+    m_types.resize(tiles);
+    std::memcpy(m_types.data(), types, tiles * sizeof(HexType));
+    m_opts.assign(opts, opts + tiles);
+    m_distance.assign(distance, distance + tiles);
+    m_board = std::move(board);
+
+    m_cat = cat;
+    m_board.setCat(cat.i, cat.j);
+    m_status = Status(header.status);
+    m_hover = -1;
+    m_journal.clear();
+    m_ply = 0;
+    touchAll();
+}
@@ -0,0 +1,292 @@
+#include <algorithm>
+
+#include "rng.hpp"
+#include "solver.hpp"
+
+// Table data: outcome in bits 0-1, depth in bits 2-17, move + 1 above
+#define PACK(outcome, depth, move) \
+    (std::uint64_t(outcome) | std::uint64_t(depth) << 2 | std::uint64_t((move) + 1) << 18)
+
+struct Solver::Worker {
+    BitBoard board;
+    int width = 0;
+    int cat = 0;
+    std::uint64_t key = 0;
+    std::uint64_t nodes = 0;
+
+    std::vector<std::vector<int>> moves; // One list per ply
+    std::vector<int> way;
+    std::vector<unsigned> stamp;
+    unsigned generation = 0;
+};
+
+Solver::Solver(unsigned threads, int table_bits)
+    : m_threads(std::max(1u, threads)),
+      m_mask((std::uint64_t(1) << table_bits) - 1),
+      m_table(new Entry[m_mask + 1])
+{
+}
+
+void Solver::prepare(int width, int height)
+{
+    if (width == m_width and height == m_height)
+        return;
+
+    m_width = width;
+    m_height = height;
+    const int tiles = width * height;
+
+    // Fixed seed, so keys are stable between runs
+    std::uint64_t seed = 0x9e3779b97f4a7c15ull;
+
+    m_zobrist_wall.resize(tiles);
+    m_zobrist_cat.resize(tiles);
+    for (int k = 0; k < tiles; ++k) {
+        m_zobrist_wall[k] = splitmix64(seed);
+        m_zobrist_cat[k] = splitmix64(seed);
+    }
+
+    for (std::uint64_t k = 0; k <= m_mask; ++k) {
+        m_table[k].check.store(0, std::memory_order_relaxed);
+        m_table[k].data.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool Solver::probe(std::uint64_t key, Outcome& outcome, int& depth, int& move) const
+{
+    const Entry& entry = m_table[key & m_mask];
+    const std::uint64_t data = entry.data.load(std::memory_order_relaxed);
+    const std::uint64_t check = entry.check.load(std::memory_order_relaxed);
+
+    if ((check ^ data) != key or data == 0)
+        return false;
+
+    outcome = Outcome(data & 3);
+    depth = int(data >> 2 & 0xffff);
+    move = int(data >> 18) - 1;
+    return true;
+}
+
+void Solver::store(std::uint64_t key, Outcome outcome, int depth, int move)
+{
+    const std::uint64_t data = PACK(outcome, depth, move);
+    Entry& entry = m_table[key & m_mask];
+    entry.check.store(key ^ data, std::memory_order_relaxed);
+    entry.data.store(data, std::memory_order_relaxed);
+}
+
+void Solver::generate(Worker& w, int depth, std::vector<int>& moves)
+{
+    moves.clear();
+    w.board.catWay(w.way, std::numeric_limits<int>::max());
+
+    // A wall off the cat's way leaves that way open, so only those tiles can win at once
+    moves = w.way;
+    if (depth == 1)
+        return;
+
+    if (++w.generation == 0) {
+        std::fill(w.stamp.begin(), w.stamp.end(), 0);
+        w.generation = 1;
+    }
+    for (int m : moves)
+        w.stamp[m] = w.generation;
+    w.stamp[w.cat] = w.generation;
+
+    const int height = w.board.height();
+    auto add = [&](int i, int j) {
+        const int m = i * w.width + j;
+        if (i < 0 or i >= height or j < 0 or j >= w.width or
+            w.stamp[m] == w.generation or w.board.wall(i, j))
+            return;
+        w.stamp[m] = w.generation;
+        moves.push_back(m);
+    };
+
+    // Then the tiles around the cat, then everything else
+    const int i = w.cat / w.width, j = w.cat % w.width;
+    add(i+1, j - (i&1)); add(i+1, j+1 - (i&1));
+    add(i, j-1); add(i, j+1);
+    add(i-1, j - (i&1)); add(i-1, j+1 - (i&1));
+
+    for (int r = 0; r < height; ++r)
+        for (int c = 0; c < w.width; ++c)
+            add(r, c);
+}
+
+Solver::Outcome Solver::play(Worker& w, int move, int depth, int ply)
+{
+    const int i = move / w.width, j = move % w.width;
+    w.board.setWall(i, j);
+    w.key ^= m_zobrist_wall[move];
+
+    Outcome outcome;
+    const int distance = w.board.catWay(w.way, 1);
+    if (distance < 0)
+        outcome = Outcome::win;
+    else if (distance <= 1)
+        outcome = Outcome::loss;
+    else {
+        const int from = w.cat, to = w.way.front();
+        w.board.setCat(to / w.width, to % w.width);
+        w.cat = to;
+        w.key ^= m_zobrist_cat[from] ^ m_zobrist_cat[to];
+
+        outcome = search(w, depth - 1, ply + 1);
+
+        w.board.setCat(from / w.width, from % w.width);
+        w.cat = from;
+        w.key ^= m_zobrist_cat[from] ^ m_zobrist_cat[to];
+    }
+
+    w.board.clearWall(i, j);
+    w.key ^= m_zobrist_wall[move];
+    return outcome;
+}
+
+Solver::Outcome Solver::search(Worker& w, int depth, int ply)
+{
+    ++w.nodes;
+    if (m_stop.load(std::memory_order_relaxed))
+        return Outcome::unknown;
+
+    Outcome cached;
+    int cached_depth, cached_move = -1;
+    if (probe(w.key, cached, cached_depth, cached_move)) {
+        if (cached == Outcome::loss)
+            return Outcome::loss;
+        if (cached == Outcome::win and cached_depth <= depth)
+            return Outcome::win;
+        if (cached == Outcome::unknown and cached_depth >= depth)
+            return Outcome::unknown;
+    }
+
+    if (depth == 0)
+        return Outcome::unknown;
+
+    // Next to two open final tiles the cat escapes whatever the player does
+    const int i = w.cat / w.width, j = w.cat % w.width;
+    const int neighbors[6][2] = {
+        {i+1, j - (i&1)}, {i+1, j+1 - (i&1)},
+        {i, j-1}, {i, j+1},
+        {i-1, j - (i&1)}, {i-1, j+1 - (i&1)}
+    };
+    int exits = 0;
+    for (auto &n : neighbors)
+        if (n[0] >= 0 and n[0] < w.board.height() and n[1] >= 0 and n[1] < w.width and
+            w.board.final(n[0], n[1]) and not w.board.wall(n[0], n[1]))
+            ++exits;
+    if (exits >= 2) {
+        store(w.key, Outcome::loss, depth, -1);
+        return Outcome::loss;
+    }
+
+    if (int(w.moves.size()) <= ply)
+        w.moves.resize(ply + 1);
+    std::vector<int>& moves = w.moves[ply];
+    generate(w, depth, moves);
+
+    // Pruned walls at the last ply can't be proven lost while the cat is far away
+    Outcome result = (depth == 1 and w.way.size() > 1) ? Outcome::unknown : Outcome::loss;
+    if (moves.empty())
+        result = Outcome::unknown;
+
+    // Try the remembered best wall first
+    if (cached_move >= 0) {
+        auto found = std::find(moves.begin(), moves.end(), cached_move);
+        if (found != moves.end())
+            std::rotate(moves.begin(), found, found + 1);
+    }
+
+    int best = -1;
+    for (int move : moves) {
+        const Outcome outcome = play(w, move, depth, ply);
+        if (outcome == Outcome::win) {
+            result = Outcome::win;
+            best = move;
+            break;
+        }
+        if (outcome == Outcome::unknown)
+            result = Outcome::unknown;
+    }
+
+    // An aborted subtree proves nothing
+    if (not m_stop.load(std::memory_order_relaxed))
+        store(w.key, result, depth, best);
+    return result;
+}
+
+Solver::Result Solver::solve(const Map& map, int max_depth)
+{
+    Result result;
+    if (map.status() != Status::playing) {
+        result.outcome = map.status() == Status::win ? Outcome::win : Outcome::loss;
+        return result;
+    }
+
+    const int width = int(map.width());
+    const int tiles = width * int(map.height());
+    prepare(width, int(map.height()));
+
+    Worker root;
+    root.board = map.board();
+    root.width = width;
+    root.cat = map.cat().i * width + map.cat().j;
+    root.stamp.assign(tiles, 0);
+    root.key = m_zobrist_cat[root.cat];
+    for (int k = 0; k < tiles; ++k)
+        if (root.board.wall(k / width, k % width))
+            root.key ^= m_zobrist_wall[k];
+
+    std::vector<std::uint64_t> nodes(m_threads, 0);
+
+    for (int depth = 1; depth <= max_depth; ++depth) {
+        std::vector<int> moves;
+        generate(root, depth, moves);
+
+        std::vector<Outcome> outcomes(moves.size(), Outcome::unknown);
+        std::atomic<std::size_t> next{0};
+        m_stop = false;
+
+        auto work = [&](unsigned thread) {
+            Worker w = root;
+            while (not m_stop.load(std::memory_order_relaxed)) {
+                const std::size_t k = next.fetch_add(1);
+                if (k >= moves.size())
+                    break;
+
+                outcomes[k] = play(w, moves[k], depth, 0);
+                if (outcomes[k] == Outcome::win)
+                    m_stop = true;
+            }
+            nodes[thread] += w.nodes;
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned t = 1; t < m_threads; ++t)
+            threads.emplace_back(work, t);
+        work(0);
+        for (auto &t : threads)
+            t.join();
+
+        auto win = std::find(outcomes.begin(), outcomes.end(), Outcome::win);
+        if (win != outcomes.end()) {
+            const int move = moves[win - outcomes.begin()];
+            result.outcome = Outcome::win;
+            result.wall = Position{move / width, move % width};
+            result.moves = depth;
+            break;
+        }
+
+        const bool lost = std::all_of(outcomes.begin(), outcomes.end(),
+                                      [](Outcome o) { return o == Outcome::loss; });
+        if (lost and not moves.empty() and (depth > 1 or moves.size() == 1)) {
+            result.outcome = Outcome::loss;
+            break;
+        }
+    }
+
+    for (auto n : nodes)
+        result.nodes += n;
+    return result;
+}
@@ -0,0 +1,64 @@
+#ifndef SOLVER_HPP
+#define SOLVER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "map.hpp"
+
+// Proves whether the player can still enclose the cat. The cat's reply to a
+// wall is fixed by the rule of Map::turn, so every node belongs to the
+// player: a node is won as soon as one wall wins and lost only when every
+// wall loses, which is all alpha-beta reduces to in this game.
+class Solver {
+public:
+    enum class Outcome {
+        unknown,
+        win,
+        loss
+    };
+
+    struct Result {
+        Outcome outcome = Outcome::unknown;
+        Position wall = {-1, -1}; // First wall of the win
+        int moves = 0;            // Walls needed to win
+        std::uint64_t nodes = 0;
+    };
+
+    explicit Solver(unsigned threads = std::thread::hardware_concurrency(), int table_bits = 22);
+
+    // Iterative deepening up to max_depth walls, root moves spread over the threads
+    Result solve(const Map& map, int max_depth = 8);
+
+private:
+    // Lock-free slot: a torn write makes check ^ data miss the key
+    struct Entry {
+        std::atomic<std::uint64_t> check{0};
+        std::atomic<std::uint64_t> data{0};
+    };
+
+    struct Worker;
+
+    unsigned m_threads;
+    std::uint64_t m_mask;
+    std::unique_ptr<Entry[]> m_table;
+
+    int m_width = 0, m_height = 0;
+    std::vector<std::uint64_t> m_zobrist_wall;
+    std::vector<std::uint64_t> m_zobrist_cat;
+
+    std::atomic<bool> m_stop{false};
+
+    void prepare(int width, int height);
+    bool probe(std::uint64_t key, Outcome& outcome, int& depth, int& move) const;
+    void store(std::uint64_t key, Outcome outcome, int depth, int move);
+
+    void generate(Worker& w, int depth, std::vector<int>& moves);
+    Outcome play(Worker& w, int move, int depth, int ply);
+    Outcome search(Worker& w, int depth, int ply);
+};
+
+#endif // SOLVER_HPP
@@ -2,308 +2,805 @@
 #include <iostream>
 
 #include <vector>
-#include <fstream>
 #include <cstring>
 #include <thread>
-#include <bit>
+#include <chrono>
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <stdexcept>
+#include <memory>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-#include <AL/al.h>
 #include <AL/alc.h>
 
+#include "mapped_file.hpp"
+#include "mixer.hpp"
+
 static ALCdevice *openALDevice = nullptr;
 static ALCcontext *openALcontext = nullptr;
 
+// Sources in the voice pool, the most sounds heard at once
+#define VOICE_COUNT 16
+
+// Clips from this size on are mapped instead of read
+#define WAV_MAP_SIZE (256 << 10)
+
+// Bytes per queued stream buffer, about 0.2 s of 44.1 kHz 16-bit stereo
+#define STREAM_CHUNK (32 << 10)
+
+// Frames the software mixer renders at a time
+#define MIX_BLOCK 1024
+
+// How often the audio thread checks whether playing clips have ended
+#define AUDIO_POLL_INTERVAL std::chrono::milliseconds(10)
+
 #define CHECK_AL_ERRORS() check_al_errors(__FILE__, __LINE__)
 #define CHECK_ALC_ERRORS() check_alc_errors(__FILE__, __LINE__, openALDevice)
 
-static char* load_wav(const std::string& filename,
-               std::uint8_t& channels,
-               std::int32_t& sampleRate,
-               std::uint8_t& bitsPerSample,
-               ALsizei& size);
-static bool load_wav_file_header(std::ifstream& file,
-                          std::uint8_t& channels,
-                          std::int32_t& sampleRate,
-                          std::uint8_t& bitsPerSample,
-                          ALsizei& size);
-std::int32_t convert_to_int(char* buffer, std::size_t len);
 static bool check_al_errors(const std::string& filename, const std::uint_fast32_t line);
 static bool check_alc_errors(const std::string& filename, const std::uint_fast32_t line, ALCdevice* device);
 
-void SoundSystem::init() {
-    openALDevice = alcOpenDevice(nullptr);
-    if (!CHECK_ALC_ERRORS()) return;
+// Where the audio thread sends its samples: an OpenAL device, or the
+// software mixer on machines without one. Names are AL buffer and source
+// names either way.
+class AudioBackend {
+public:
+    virtual ~AudioBackend() = default;
+
+    virtual ALuint createBuffer() = 0;
+    virtual void deleteBuffer(ALuint buffer) = 0;
+    virtual bool bufferData(ALuint buffer, ALenum format, const char *data, ALsizei size, ALsizei rate) = 0;
+
+    // At the origin, at full gain, not looping
+    virtual ALuint createSource() = 0;
+    virtual void deleteSource(ALuint source) = 0;
+    virtual void move(ALuint source, ALfloat x, ALfloat y, ALfloat z) = 0;
+    // Stops the source and leaves only `buffer` queued, nothing for 0
+    virtual void attach(ALuint source, ALuint buffer) = 0;
+    virtual bool queue(ALuint source, ALuint buffer) = 0;
+    virtual ALuint unqueue(ALuint source) = 0;
+    virtual int processed(ALuint source) = 0;
+    virtual int queued(ALuint source) = 0;
+
+    virtual bool play(ALuint source) = 0;
+    virtual void stop(ALuint source) = 0;
+    virtual bool playing(ALuint source) = 0;
+
+    // Once per pass of the audio thread
+    virtual void update() {}
+};
+
+class OpenALBackend : public AudioBackend {
+    OpenALBackend() = default;
+
+public:
+    // Null when there is no device to open
+    static std::unique_ptr<AudioBackend> open() {
+        ALCdevice *device = alcOpenDevice(nullptr);
+        if (!device)
+            return nullptr;
+
+        ALCcontext *context = alcCreateContext(device, nullptr);
+        if (!context || !alcMakeContextCurrent(context)) {
+            if (context)
+                alcDestroyContext(context);
+            alcCloseDevice(device);
+            return nullptr;
+        }
+
+        openALDevice = device;
+        openALcontext = context;
+        return std::unique_ptr<AudioBackend>(new OpenALBackend());
+    }
 
-    openALcontext = alcCreateContext(openALDevice, nullptr);
-    if (!CHECK_ALC_ERRORS()) return;
+    ~OpenALBackend() override {
+        alcMakeContextCurrent(nullptr);
+        CHECK_ALC_ERRORS();
 
-    ALCboolean contextMadeCurrent = false;
-    contextMadeCurrent = alcMakeContextCurrent(openALcontext);
-    if (!CHECK_ALC_ERRORS()) {
-    std::cerr << "ERROR: Could not make audio context current" << std::endl;
-    return;
+        alcDestroyContext(openALcontext);
+        CHECK_ALC_ERRORS();
+
+        ALCboolean closed;
+        closed = alcCloseDevice(openALDevice);
+        if (!closed)
+        std::cerr << "ERROR: Could not close an audio device\n";
+        CHECK_ALC_ERRORS();
     }
-}
 
-Sound::Sound(const char *file_name)
-{
-    std::uint8_t channels;
-    std::int32_t sampleRate;
-    std::uint8_t bitsPerSample;
-    ALsizei soundSize;
-    char* soundData;
-    if (!(soundData = load_wav(file_name, channels, sampleRate, bitsPerSample, soundSize))) {
-    std::cerr << "ERROR: Could not load wav" << std::endl;
-    return;
+    ALuint createBuffer() override {
+        ALuint buffer = 0;
+        alGenBuffers(1, &buffer);
+        CHECK_AL_ERRORS();
+        return buffer;
     }
 
-    alGenBuffers(1, &buffer);
-    if (!CHECK_AL_ERRORS()) return;
+    void deleteBuffer(ALuint buffer) override {
+        alDeleteBuffers(1, &buffer);
+        CHECK_AL_ERRORS();
+    }
 
-    ALenum format;
+    bool bufferData(ALuint buffer, ALenum format, const char *data, ALsizei size, ALsizei rate) override {
+        alBufferData(buffer, format, data, size, rate);
+        return CHECK_AL_ERRORS();
+    }
 
-    if(channels == 1 && bitsPerSample == 8)
-    format = AL_FORMAT_MONO8;
-    else if(channels == 1 && bitsPerSample == 16)
-    format = AL_FORMAT_MONO16;
-    else if(channels == 2 && bitsPerSample == 8)
-    format = AL_FORMAT_STEREO8;
-    else if(channels == 2 && bitsPerSample == 16)
-    format = AL_FORMAT_STEREO16;
-    else
-    {
-    std::cerr
-        << "ERROR: unrecognised wave format: "
-        << channels << " channels, "
-        << bitsPerSample << " bps" << std::endl;
-    return;
+    ALuint createSource() override {
+        ALuint source = 0;
+        alGenSources(1, &source);
+        if (!CHECK_AL_ERRORS()) return 0;
+
+        alSourcef(source, AL_PITCH, 1);
+        alSourcef(source, AL_GAIN, 1.0f);
+        alSource3f(source, AL_POSITION, 0, 0, 0);
+        alSource3f(source, AL_VELOCITY, 0, 0, 0);
+        alSourcei(source, AL_LOOPING, AL_FALSE);
+        CHECK_AL_ERRORS();
+        return source;
     }
 
-    alBufferData(buffer, format, soundData, soundSize, sampleRate);
-    if (!CHECK_AL_ERRORS()) return;
+    void deleteSource(ALuint source) override {
+        alDeleteSources(1, &source);
+        CHECK_AL_ERRORS();
+    }
 
-    free(soundData);    
-}
+    void move(ALuint source, ALfloat x, ALfloat y, ALfloat z) override {
+        alSource3f(source, AL_POSITION, x, y, z);
+        CHECK_AL_ERRORS();
+    }
 
-Source::Source(Sound& sound, ALfloat x, ALfloat y, ALfloat z)
-{    
-    alGenSources(1, &buffer);
-    if (!CHECK_AL_ERRORS()) return;
+    void attach(ALuint source, ALuint buffer) override {
+        alSourceStop(source);
+        alSourcei(source, AL_BUFFER, ALint(buffer));
+        CHECK_AL_ERRORS();
+    }
 
-    alSourcef(buffer, AL_PITCH, 1);
-    if (!CHECK_AL_ERRORS()) return;
+    bool queue(ALuint source, ALuint buffer) override {
+        alSourceQueueBuffers(source, 1, &buffer);
+        return CHECK_AL_ERRORS();
+    }
 
-    alSourcef(buffer, AL_GAIN, 1.0f);
-    if (!CHECK_AL_ERRORS()) return;
+    ALuint unqueue(ALuint source) override {
+        ALuint buffer = 0;
+        alSourceUnqueueBuffers(source, 1, &buffer);
+        return CHECK_AL_ERRORS() ? buffer : 0;
+    }
 
-    alSource3f(buffer, AL_POSITION, x, y, z);
-    if (!CHECK_AL_ERRORS()) return;
+    int processed(ALuint source) override {
+        ALint count = 0;
+        alGetSourcei(source, AL_BUFFERS_PROCESSED, &count);
+        return CHECK_AL_ERRORS() ? count : 0;
+    }
 
-    alSource3f(buffer, AL_VELOCITY, 0, 0, 0);
-    if (!CHECK_AL_ERRORS()) return;
+    int queued(ALuint source) override {
+        ALint count = 0;
+        alGetSourcei(source, AL_BUFFERS_QUEUED, &count);
+        return CHECK_AL_ERRORS() ? count : 0;
+    }
 
-    alSourcei(buffer, AL_LOOPING, AL_FALSE);
-    if (!CHECK_AL_ERRORS()) return;
+    bool play(ALuint source) override {
+        alSourcePlay(source);
+        return CHECK_AL_ERRORS();
+    }
 
-    alSourcei(buffer, AL_BUFFER, sound.buffer);
-    if (!CHECK_AL_ERRORS()) return;
+    void stop(ALuint source) override {
+        alSourceStop(source);
+        CHECK_AL_ERRORS();
+    }
 
-}
+    bool playing(ALuint source) override {
+        ALint state = AL_STOPPED;
+        alGetSourcei(source, AL_SOURCE_STATE, &state);
+        return CHECK_AL_ERRORS() && state == AL_PLAYING;
+    }
+};
+
+// Mixes in software as time passes, into a WAV file or nowhere. The mix is
+// not spatialised, positions are ignored.
+class MixerBackend : public AudioBackend {
+    std::mutex lock; // Sounds and sources are made on the game thread
+    Mixer mixer;
+    WavWriter out;
+    bool writing = false;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::uint64_t rendered = 0;
+    std::vector<float> mix;
+    std::vector<std::int16_t> pcm;
+
+public:
+    explicit MixerBackend(const std::string& path) : mix(2 * MIX_BLOCK), pcm(2 * MIX_BLOCK) {
+        if (!path.empty() && !(writing = out.open(path, mixer.rate())))
+            std::cerr << "ERROR: Could not write \"" << path << "\"" << std::endl;
+    }
 
-void Source::move(ALfloat x, ALfloat y, ALfloat z) {
-    alSource3f(buffer, AL_POSITION, x, y, z);
-    if (!CHECK_AL_ERRORS()) return;
-}
+    ALuint createBuffer() override {
+        std::lock_guard<std::mutex> guard(lock);
+        return mixer.createBuffer();
+    }
 
-//void Sound::playSource(Source_Info source) {
-////    alSourcei(source.buffer, AL_BUFFER, sound.buffer);
-////    if (!CHECK_AL_ERRORS()) return;
+    void deleteBuffer(ALuint buffer) override {
+        std::lock_guard<std::mutex> guard(lock);
+        mixer.deleteBuffer(buffer);
+    }
 
-//}
+    bool bufferData(ALuint buffer, ALenum format, const char *data, ALsizei size, ALsizei rate) override {
+        Mixer::Format f;
+        if (format == AL_FORMAT_MONO8) f = Mixer::Format::Mono8;
+        else if (format == AL_FORMAT_MONO16) f = Mixer::Format::Mono16;
+        else if (format == AL_FORMAT_STEREO8) f = Mixer::Format::Stereo8;
+        else if (format == AL_FORMAT_STEREO16) f = Mixer::Format::Stereo16;
+        else return false;
+
+        std::lock_guard<std::mutex> guard(lock);
+        mixer.bufferData(buffer, f, data, std::size_t(size), rate);
+        return true;
+    }
 
-SoundSystem::~SoundSystem() {
-    alcMakeContextCurrent(nullptr);
-    CHECK_ALC_ERRORS();
+    ALuint createSource() override {
+        std::lock_guard<std::mutex> guard(lock);
+        return mixer.createVoice();
+    }
 
-    alcDestroyContext(openALcontext);
-    CHECK_ALC_ERRORS();
+    void deleteSource(ALuint source) override {
+        std::lock_guard<std::mutex> guard(lock);
+        mixer.deleteVoice(source);
+    }
 
-    ALCboolean closed;
-    closed = alcCloseDevice(openALDevice);
-    if (!closed)
-    std::cerr << "ERROR: Could not close an audio device\n";
-    CHECK_ALC_ERRORS();
-}
+    void move(ALuint, ALfloat, ALfloat, ALfloat) override {}
 
-std::int32_t convert_to_int(char* buffer, std::size_t len)
-{
-    std::int32_t a = 0;
-    if(std::endian::native == std::endian::little)
-    std::memcpy(&a, buffer, len);
-    else
-    for(std::size_t i = 0; i < len; ++i)
-        reinterpret_cast<char*>(&a)[3 - i] = buffer[i];
-    return a;
-}
+    void attach(ALuint source, ALuint buffer) override {
+        std::lock_guard<std::mutex> guard(lock);
+        mixer.attach(source, buffer);
+    }
 
-bool load_wav_file_header(std::ifstream& file,
-                          std::uint8_t& channels,
-                          std::int32_t& sampleRate,
-                          std::uint8_t& bitsPerSample,
-                          ALsizei& size)
-{
-    char buffer[4];
-    if(!file.is_open())
-        return false;
+    bool queue(ALuint source, ALuint buffer) override {
+        std::lock_guard<std::mutex> guard(lock);
+        mixer.queue(source, buffer);
+        return true;
+    }
 
-    // the RIFF
-    if(!file.read(buffer, 4))
-    {
-        std::cerr << "ERROR: could not read RIFF" << std::endl;
-        return false;
+    ALuint unqueue(ALuint source) override {
+        std::lock_guard<std::mutex> guard(lock);
+        return mixer.unqueue(source);
     }
-    if(std::strncmp(buffer, "RIFF", 4) != 0)
-    {
-        std::cerr << "ERROR: file is not a valid WAVE file (header doesn't begin with RIFF)" << std::endl;
-        return false;
+
+    int processed(ALuint source) override {
+        std::lock_guard<std::mutex> guard(lock);
+        return int(mixer.processed(source));
     }
 
-    // the size of the file
-    if(!file.read(buffer, 4))
-    {
-        std::cerr << "ERROR: could not read size of file" << std::endl;
-        return false;
+    int queued(ALuint source) override {
+        std::lock_guard<std::mutex> guard(lock);
+        return int(mixer.queued(source));
     }
 
-    // the WAVE
-    if(!file.read(buffer, 4))
-    {
-        std::cerr << "ERROR: could not read WAVE" << std::endl;
-        return false;
+    bool play(ALuint source) override {
+        std::lock_guard<std::mutex> guard(lock);
+        mixer.play(source);
+        return true;
     }
-    if(std::strncmp(buffer, "WAVE", 4) != 0)
-    {
-        std::cerr << "ERROR: file is not a valid WAVE file (header doesn't contain WAVE)" << std::endl;
-        return false;
+
+    void stop(ALuint source) override {
+        std::lock_guard<std::mutex> guard(lock);
+        mixer.stop(source);
     }
 
-    // "fmt/0"
-    if(!file.read(buffer, 4))
-    {
-        std::cerr << "ERROR: could not read fmt/0" << std::endl;
-        return false;
+    bool playing(ALuint source) override {
+        std::lock_guard<std::mutex> guard(lock);
+        return mixer.playing(source);
     }
 
-    // this is always 16, the size of the fmt data chunk
-    if(!file.read(buffer, 4))
-    {
-        std::cerr << "ERROR: could not read the 16" << std::endl;
-        return false;
+    // Renders the time since the last call, silence included when it goes
+    // to a file
+    void update() override {
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const std::uint64_t due = std::uint64_t(elapsed * mixer.rate());
+
+        if (!writing) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!mixer.active()) {
+                rendered = due;
+                return;
+            }
+        }
+
+        while (rendered < due) {
+            const std::size_t frames = std::size_t(std::min<std::uint64_t>(MIX_BLOCK, due - rendered));
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                mixer.render(mix.data(), frames);
+            }
+            if (writing) {
+                floatToPcm16(mix.data(), pcm.data(), 2 * frames);
+                out.write(pcm.data(), frames);
+            }
+            rendered += frames;
+        }
     }
+};
 
-    // PCM should be 1?
-    if(!file.read(buffer, 2))
-    {
-        std::cerr << "ERROR: could not read PCM" << std::endl;
-        return false;
+static std::unique_ptr<AudioBackend> backend;
+
+// Sounds made before SoundSystem::init, or without it, go to a silent mixer
+static AudioBackend& audio() {
+    if (!backend)
+        backend = std::make_unique<MixerBackend>(std::string());
+    return *backend;
+}
+
+void SoundSystem::init() {
+    backend = OpenALBackend::open();
+    if (!backend) {
+        std::cerr << "WARNING: no audio device, mixing in software without output" << std::endl;
+        backend = std::make_unique<MixerBackend>(std::string());
     }
+    start();
+}
 
-    // the number of channels
-    if(!file.read(buffer, 2))
-    {
-        std::cerr << "ERROR: could not read number of channels" << std::endl;
-        return false;
+void SoundSystem::initSoftware(const std::string& path) {
+    backend = std::make_unique<MixerBackend>(path);
+    start();
+}
+
+void SoundSystem::start() {
+    voices.resize(VOICE_COUNT);
+    for (Voice &voice : voices)
+        voice.source = audio().createSource();
+
+    worker = std::thread(&SoundSystem::run, this);
+}
+
+void SoundSystem::playVoice(const Command& command) {
+    Voice *chosen = nullptr;
+
+    // Past its limit a sound restarts its own oldest copy
+    if (command.limit > 0) {
+        int copies = 0;
+        Voice *oldest = nullptr;
+        for (Voice &voice : voices)
+            if (voice.buffer == command.source) {
+                ++copies;
+                if (!oldest || voice.started < oldest->started)
+                    oldest = &voice;
+            }
+        if (copies >= command.limit)
+            chosen = oldest;
     }
-    channels = convert_to_int(buffer, 2);
 
-    // sample rate
-    if(!file.read(buffer, 4))
-    {
-        std::cerr << "ERROR: could not read sample rate" << std::endl;
-        return false;
+    // Else a free voice, else the oldest of the lowest priority
+    if (!chosen) {
+        auto free = std::find_if(voices.begin(), voices.end(), [](const Voice &voice) { return voice.buffer == 0; });
+        if (free != voices.end())
+            chosen = &*free;
+    }
+    if (!chosen) {
+        Voice *victim = nullptr;
+        for (Voice &voice : voices)
+            if (!victim || voice.priority < victim->priority ||
+                (voice.priority == victim->priority && voice.started < victim->started))
+                victim = &voice;
+        if (!victim || victim->priority > command.priority)
+            return;
+        chosen = victim;
     }
-    sampleRate = convert_to_int(buffer, 4);
 
-    // (sampleRate * bitsPerSample * channels) / 8
-    if(!file.read(buffer, 4))
-    {
-        std::cerr << "ERROR: could not read (sampleRate * bitsPerSample * channels) / 8" << std::endl;
-        return false;
+    audio().attach(chosen->source, command.source);
+    audio().move(chosen->source, command.x, command.y, command.z);
+    if (!audio().play(chosen->source)) {
+        chosen->buffer = 0;
+        return;
     }
 
-    // ?? dafaq
-    if(!file.read(buffer, 2))
-    {
-        std::cerr << "ERROR: could not read dafaq" << std::endl;
+    chosen->buffer = command.source;
+    chosen->priority = command.priority;
+    chosen->started = ++voice_clock;
+}
+
+bool SoundSystem::post(const Command& command) {
+    if (!worker.joinable())
         return false;
-    }
 
-    // bitsPerSample
-    if(!file.read(buffer, 2))
-    {
-        std::cerr << "ERROR: could not read bits per sample" << std::endl;
+    const std::size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == queue_size)
         return false;
+
+    queue[h % queue_size] = command;
+    head.store(h + 1, std::memory_order_seq_cst);
+    // The worker drains the whole ring per wake-up and looks at head again
+    // after each command, so only a post to a drained ring must wake it
+    if (tail.load(std::memory_order_seq_cst) == h)
+        wake.release();
+    return true;
+}
+
+void SoundSystem::sync() {
+    if (!worker.joinable())
+        return;
+    // It would wait on itself: finished callbacks must not destroy sounds,
+    // sources or streams
+    assert(std::this_thread::get_id() != worker.get_id());
+
+    // The worker notifies after each drain of the ring
+    const std::size_t h = head.load(std::memory_order_relaxed);
+    for (std::size_t t = tail.load(std::memory_order_acquire); t != h; t = tail.load(std::memory_order_acquire))
+        tail.wait(t, std::memory_order_acquire);
+}
+
+void SoundSystem::run() {
+    // Sources started here and not yet seen stopped
+    std::vector<std::pair<ALuint, const std::function<void()> *>> playing;
+    std::vector<Stream *> streams;
+    auto forget = [&playing](ALuint source) {
+        playing.erase(std::remove_if(playing.begin(), playing.end(),
+                                     [source](const auto &p) { return p.first == source; }),
+                      playing.end());
+    };
+
+    for (;;) {
+        const bool voicing = std::any_of(voices.begin(), voices.end(),
+                                         [](const Voice &voice) { return voice.buffer != 0; });
+
+        // Sleep until a command comes, or until the next check of the clips
+        if (playing.empty() && !voicing && streams.empty())
+            wake.acquire();
+        else
+            wake.try_acquire_for(AUDIO_POLL_INTERVAL);
+
+        // The time slept passes with what was playing, before the commands
+        // that woke us take effect
+        audio().update();
+
+        const std::size_t drained = tail.load(std::memory_order_relaxed);
+        std::size_t t = drained;
+        while (t != head.load(std::memory_order_seq_cst)) {
+            const Command &command = queue[t % queue_size];
+            switch (command.kind) {
+            case Command::Play:
+                audio().play(command.source);
+                forget(command.source);
+                playing.emplace_back(command.source, command.finished);
+                break;
+            case Command::Stop:
+            case Command::Release:
+                audio().stop(command.source);
+                forget(command.source);
+                break;
+            case Command::Move:
+                audio().move(command.source, command.x, command.y, command.z);
+                break;
+            case Command::PlayVoice:
+                playVoice(command);
+                break;
+            case Command::PlayStream:
+                command.stream->start();
+                if (std::find(streams.begin(), streams.end(), command.stream) == streams.end())
+                    streams.push_back(command.stream);
+                break;
+            case Command::StopStream:
+                audio().attach(command.stream->source, 0);
+                streams.erase(std::remove(streams.begin(), streams.end(), command.stream), streams.end());
+                break;
+            case Command::Forget:
+                for (Voice &voice : voices)
+                    if (voice.buffer == command.source) {
+                        audio().attach(voice.source, 0);
+                        voice.buffer = 0;
+                    }
+                break;
+            }
+            tail.store(++t, std::memory_order_seq_cst);
+        }
+        if (t != drained)
+            tail.notify_all();
+
+        if (stopping.load(std::memory_order_acquire))
+            break;
+
+        for (std::size_t k = 0; k < playing.size();) {
+            if (audio().playing(playing[k].first)) {
+                ++k;
+                continue;
+            }
+
+            if (playing[k].second && *playing[k].second)
+                (*playing[k].second)();
+            playing.erase(playing.begin() + k);
+        }
+
+        streams.erase(std::remove_if(streams.begin(), streams.end(),
+                                     [](Stream *stream) { return !stream->refill(); }),
+                      streams.end());
+
+        for (Voice &voice : voices) {
+            if (voice.buffer == 0)
+                continue;
+            if (!audio().playing(voice.source))
+                voice.buffer = 0;
+        }
     }
-    bitsPerSample = convert_to_int(buffer, 2);
+}
 
-    // data chunk header "data"
-    if(!file.read(buffer, 4))
-    {
-        std::cerr << "ERROR: could not read data chunk header" << std::endl;
-        return false;
+// Little-endian field of a RIFF file
+static std::uint32_t riffField(const unsigned char *bytes, std::size_t len)
+{
+    std::uint32_t value = 0;
+    for (std::size_t i = 0; i < len; ++i)
+        value |= std::uint32_t(bytes[i]) << (8 * i);
+    return value;
+}
+
+// A stream reads its samples as they play, only clips are warmed up front
+static Sound::Wave readWave(const char *file_name, bool warm)
+{
+    Sound::Wave wave;
+    // Mapping costs more than reading a short clip in one go
+    const int fd = ::open(file_name, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) < 0) {
+        std::cerr << "ERROR: Could not open \"" << file_name << "\"" << std::endl;
+        if (fd >= 0)
+            ::close(fd);
+        return Sound::Wave();
     }
-    if(std::strncmp(buffer, "data", 4) != 0)
-    {
-        std::cerr << "ERROR: file is not a valid WAVE file (doesn't have 'data' tag)" << std::endl;
-        return false;
+
+    const unsigned char *data = nullptr;
+    std::size_t size = std::size_t(st.st_size);
+    if (size >= WAV_MAP_SIZE) {
+        ::close(fd);
+        try {
+            auto file = std::make_shared<const MappedFile>(file_name);
+            data = file->data();
+            size = file->size();
+            wave.storage = file;
+        } catch (std::runtime_error& e) {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            return Sound::Wave();
+        }
+    } else {
+        auto bytes = std::shared_ptr<unsigned char[]>(new unsigned char[size]);
+        const bool complete = ::read(fd, bytes.get(), size) == ssize_t(size);
+        ::close(fd);
+        if (!complete) {
+            std::cerr << "ERROR: Could not read \"" << file_name << "\"" << std::endl;
+            return Sound::Wave();
+        }
+        data = bytes.get();
+        wave.storage = bytes;
     }
 
-    // size of data
-    if(!file.read(buffer, 4))
-    {
-        std::cerr << "ERROR: could not read data size" << std::endl;
-        return false;
+    if (size < 12 || std::memcmp(data, "RIFF", 4) != 0 || std::memcmp(data + 8, "WAVE", 4) != 0) {
+        std::cerr << "ERROR: \"" << file_name << "\" is not a valid WAVE file" << std::endl;
+        return Sound::Wave();
     }
-    size = convert_to_int(buffer, 4);
 
-    /* cannot be at the end of file */
-    if(file.eof())
-    {
-        std::cerr << "ERROR: reached EOF on the file" << std::endl;
-        return false;
+    // Chunks come in any order, LIST and friends are skipped
+    const unsigned char *fmt = nullptr;
+    std::size_t fmtLength = 0;
+    for (std::size_t at = 12; at + 8 <= size;) {
+        const unsigned char *chunk = data + at + 8;
+        const std::size_t length = std::min<std::size_t>(riffField(data + at + 4, 4), size - at - 8);
+
+        if (std::memcmp(data + at, "fmt ", 4) == 0 && length >= 16) {
+            fmt = chunk;
+            fmtLength = length;
+        } else if (std::memcmp(data + at, "data", 4) == 0) {
+            // ALsizei is an int
+            if (length > std::size_t(INT_MAX)) {
+                std::cerr << "ERROR: \"" << file_name << "\" has more than 2 GiB of samples" << std::endl;
+                return Sound::Wave();
+            }
+            wave.data = reinterpret_cast<const char *>(chunk);
+            wave.size = ALsizei(length);
+        }
+
+        at += 8 + length + (length & 1); // Chunks are padded to even sizes
     }
-    if(file.fail())
-    {
-        std::cerr << "ERROR: fail state set on the file" << std::endl;
-        return false;
+
+    if (!fmt || !wave.data) {
+        std::cerr << "ERROR: \"" << file_name << "\" has no fmt or data chunk" << std::endl;
+        return Sound::Wave();
     }
 
-    return true;
+    const std::uint32_t encoding = riffField(fmt, 2);
+    const std::uint32_t channels = riffField(fmt + 2, 2);
+    const std::uint32_t bitsPerSample = riffField(fmt + 14, 2);
+    // 0xFFFE is WAVE_FORMAT_EXTENSIBLE, its SubFormat GUID at 24 names the
+    // real encoding: PCM is 1 followed by the fixed KSDATAFORMAT tail
+    static const unsigned char pcmGuid[16] = {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+                                              0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+    const bool pcm = encoding == 1 ||
+                     (encoding == 0xFFFE && fmtLength >= 40 && std::memcmp(fmt + 24, pcmGuid, 16) == 0);
+    if (!pcm) {
+        std::cerr << "ERROR: \"" << file_name << "\" is not PCM" << std::endl;
+        return Sound::Wave();
+    }
+
+    if (channels == 1 && bitsPerSample == 8)
+        wave.format = AL_FORMAT_MONO8;
+    else if (channels == 1 && bitsPerSample == 16)
+        wave.format = AL_FORMAT_MONO16;
+    else if (channels == 2 && bitsPerSample == 8)
+        wave.format = AL_FORMAT_STEREO8;
+    else if (channels == 2 && bitsPerSample == 16)
+        wave.format = AL_FORMAT_STEREO16;
+    else {
+        std::cerr << "ERROR: unrecognised wave format: "
+                  << channels << " channels, "
+                  << bitsPerSample << " bps" << std::endl;
+        return Sound::Wave();
+    }
+    wave.sampleRate = ALsizei(riffField(fmt + 4, 4));
+
+    // A mapped clip faults its samples in here, not in alBufferData later
+    volatile unsigned char touch = 0;
+    for (ALsizei k = 0; warm && k < wave.size; k += 4096)
+        touch = touch + wave.data[k];
+
+    return wave;
 }
 
-char* load_wav(const std::string& filename,
-               std::uint8_t& channels,
-               std::int32_t& sampleRate,
-               std::uint8_t& bitsPerSample,
-               ALsizei& size)
+Sound::Wave Sound::decode(const char *file_name)
 {
-    std::ifstream in(filename, std::ios::binary);
-    if(!in.is_open())
-    {
-        std::cerr << "ERROR: Could not open \"" << filename << "\"" << std::endl;
-    return nullptr;
-    }
-    if(!load_wav_file_header(in, channels, sampleRate, bitsPerSample, size))
-    {
-    std::cerr << "ERROR: Could not load wav header of \"" << filename << "\"" << std::endl;
-    return nullptr;
-    }
+    return readWave(file_name, true);
+}
 
-    char* data = new char[size];
+Sound::Sound(const char *file_name) : Sound(decode(file_name)) {}
 
-    in.read(data, size);
+Sound::Sound(const Wave& wave)
+{
+    buffer = audio().createBuffer();
+    if (wave.format == 0)
+    return;
 
-    return data;
+    audio().bufferData(buffer, wave.format, wave.data, wave.size, wave.sampleRate);
+}
+
+void Sound::play(ALfloat x, ALfloat y, ALfloat z) const
+{
+    SoundSystem::Command command{SoundSystem::Command::PlayVoice, buffer, x, y, z, nullptr};
+    command.priority = std::int16_t(priority);
+    command.limit = std::int16_t(limit);
+    SoundSystem::getInstance().post(command);
+}
+
+Sound::~Sound()
+{
+    // No voice may hold the buffer when it is deleted
+    SoundSystem& sound_system = SoundSystem::getInstance();
+    sound_system.sync();
+    sound_system.post({SoundSystem::Command::Forget, buffer, 0, 0, 0, nullptr});
+    sound_system.sync();
+
+    audio().deleteBuffer(buffer);
+}
+
+Source::Source(Sound& sound, ALfloat x, ALfloat y, ALfloat z)
+{
+    buffer = audio().createSource();
+    audio().move(buffer, x, y, z);
+    audio().attach(buffer, sound.buffer);
+}
+
+void Source::play() {
+    SoundSystem::getInstance().post({SoundSystem::Command::Play, buffer, 0, 0, 0, &finished});
+}
+
+void Source::stop() {
+    SoundSystem::getInstance().post({SoundSystem::Command::Stop, buffer, 0, 0, 0, nullptr});
+}
+
+void Source::move(ALfloat x, ALfloat y, ALfloat z) {
+    SoundSystem::getInstance().post({SoundSystem::Command::Move, buffer, x, y, z, nullptr});
+}
+
+Source::~Source() {
+    // The audio thread must be done with the source before it is deleted
+    SoundSystem& sound_system = SoundSystem::getInstance();
+    sound_system.sync();
+    sound_system.post({SoundSystem::Command::Release, buffer, 0, 0, 0, nullptr});
+    sound_system.sync();
+
+    audio().deleteSource(buffer);
+}
+
+Stream::Stream(const char *file_name, bool looping) : wave(readWave(file_name, false)), looping(looping)
+{
+    source = audio().createSource(); // Looping is done by refilling
+    for (ALuint &buffer : buffers)
+        buffer = audio().createBuffer();
+}
+
+void Stream::play() {
+    SoundSystem::Command command{SoundSystem::Command::PlayStream, source, 0, 0, 0, nullptr};
+    command.stream = this;
+    SoundSystem::getInstance().post(command);
+}
+
+void Stream::stop() {
+    SoundSystem::Command command{SoundSystem::Command::StopStream, source, 0, 0, 0, nullptr};
+    command.stream = this;
+    SoundSystem::getInstance().post(command);
+}
+
+Stream::~Stream() {
+    SoundSystem& sound_system = SoundSystem::getInstance();
+    sound_system.sync();
+    stop();
+    sound_system.sync();
+
+    audio().deleteSource(source);
+    for (ALuint buffer : buffers)
+        audio().deleteBuffer(buffer);
+}
+
+bool Stream::queue(ALuint buffer) {
+    if (wave.format == 0)
+        return false;
+
+    // Whole sample frames only
+    const std::size_t frame = wave.format == AL_FORMAT_MONO8 ? 1 : wave.format == AL_FORMAT_STEREO16 ? 4 : 2;
+    const std::size_t end = std::size_t(wave.size) - std::size_t(wave.size) % frame;
+    if (offset >= end && looping)
+        offset = 0;
+
+    const std::size_t bytes = std::min<std::size_t>(STREAM_CHUNK - STREAM_CHUNK % frame, end - std::min(offset, end));
+    if (bytes == 0)
+        return false;
+
+    if (!audio().bufferData(buffer, wave.format, wave.data + offset, ALsizei(bytes), wave.sampleRate) ||
+        !audio().queue(source, buffer))
+        return false;
+
+    offset += bytes;
+    return true;
+}
+
+void Stream::start() {
+    audio().attach(source, 0); // Drops whatever is still queued
+    offset = 0;
+
+    // Sound starts after the first chunk is queued, the rest follow
+    if (!queue(buffers[0]))
+        return;
+    audio().play(source);
+    for (std::size_t k = 1; k < buffers.size() && queue(buffers[k]); ++k)
+        ;
+}
+
+bool Stream::refill() {
+    for (int processed = audio().processed(source); processed > 0; --processed)
+        queue(audio().unqueue(source));
+
+    if (audio().queued(source) == 0)
+        return false;
+
+    // A source that ran dry before the refill stops, start it again
+    if (!audio().playing(source))
+        audio().play(source);
+    return true;
+}
+
+
+//void Sound::playSource(Source_Info source) {
+////    alSourcei(source.buffer, AL_BUFFER, sound.buffer);
+////    if (!CHECK_AL_ERRORS()) return;
+
+//}
+
+SoundSystem::~SoundSystem() {
+    if (worker.joinable()) {
+        stopping.store(true, std::memory_order_release);
+        wake.release();
+        worker.join();
+    }
+
+    for (Voice &voice : voices)
+        audio().deleteSource(voice.source);
+    backend.reset();
 }
 
 bool check_al_errors(const std::string& filename, const std::uint_fast32_t line)
@@ -368,19 +865,4 @@ bool check_alc_errors(const std::string& filename, const std::uint_fast32_t line
         return false;
     }
     return true;
-}
-
-void Source::play() {
-    alSourcePlay(buffer);
-    if (!CHECK_AL_ERRORS()) return;
-
-    ALint state = AL_PLAYING;
-
-    while (state == AL_PLAYING) {
-        alGetSourcei(buffer, AL_SOURCE_STATE, &state);
-        if (!CHECK_AL_ERRORS()) return;
-    }
-}
-void Source::playAsync() {
-    std::thread(&Source::play, this).detach();
-}
+}
\ No newline at end of file
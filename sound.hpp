@@ -3,49 +3,162 @@
 
 #include <AL/al.h>
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <semaphore>
+#include <string>
+#include <thread>
+#include <vector>
+
 class Sound {
     ALuint buffer;
+    int priority = 0, limit = 0;
     friend class Source;
 
 public:
+    // The PCM samples of a WAV file, ready for alBufferData
+    struct Wave {
+        std::shared_ptr<const void> storage; // The mapping or the bytes read
+        const char *data = nullptr;
+        ALsizei size = 0;
+        ALenum format = 0;
+        ALsizei sampleRate = 0;
+    };
+
+    // Makes no AL calls, so files can be decoded on any thread
+    static Wave decode(const char *file_wav);
+
     Sound(const char *file_wav);
+    Sound(const Wave& wave);
     Sound(const Sound&) = delete;
     Sound& operator=(const Sound&) = delete;
+    // Voices of the pool hold on to `buffer` by name
+    Sound(Sound &&) = delete;
 
-    Sound(Sound &&) = default;
-
-    ~Sound() {
-        alDeleteBuffers(1, &buffer);
+    // How the sound shares the voice pool: a play steals a voice from a
+    // sound of lower or equal priority when none is free, and past `limit`
+    // copies at once (0 for no limit) it restarts its own oldest copy
+    void setMixing(int priority, int limit) {
+        this->priority = priority;
+        this->limit = limit;
     }
+
+    // Queues the sound on a pooled voice, returns at once
+    void play(ALfloat x = 0.0f, ALfloat y = 0.0f, ALfloat z = 0.0f) const;
+
+    ~Sound();
 };
 
 class Source {
     ALuint buffer;
+    std::function<void()> finished;
 
 public:
     Source(Sound& sound, ALfloat x, ALfloat y, ALfloat z);
     Source(const Source&) = delete;
     Source& operator=(const Source&) = delete;
+    // The audio thread keeps the address of `finished` while it plays
+    Source(Source &&) = delete;
 
-    Source(Source &&) = default;
+    // These only queue a command for the audio thread and return at once
     void play();
-    void playAsync();
+    void stop();
     void move(ALfloat x, ALfloat y, ALfloat z);
 
-    ~Source() {
-        alDeleteSources(1, &buffer);
+    // Called on the audio thread when a clip plays to its end, set it
+    // before the first play(). It must not destroy any Sound, Source or
+    // Stream, their destructors wait for the audio thread.
+    void onFinished(std::function<void()> callback) {
+        finished = std::move(callback);
     }
+
+    ~Source();
 };
 
+// A long track played straight from its file: the audio thread keeps a few
+// small buffers queued on the source and refills them as they play out, so
+// memory stays the same whatever the track's length
+class Stream {
+    friend class SoundSystem;
+
+    Sound::Wave wave;
+    std::array<ALuint, 4> buffers;
+    ALuint source;
+    bool looping;
+    std::size_t offset = 0; // Next byte to queue, audio thread only
+
+    bool queue(ALuint buffer);
+    void start();
+    bool refill();
+
+public:
+    Stream(const char *file_wav, bool looping);
+    Stream(const Stream&) = delete;
+    Stream& operator=(const Stream&) = delete;
+
+    // From the start, returns at once like Source::play
+    void play();
+    void stop();
+
+    ~Stream();
+};
+
+// Owns the audio output and the thread that talks to it. Commands come
+// from one thread, the one running the game loop, through a lock-free ring.
 class SoundSystem {
+public:
+    struct Command {
+        enum Kind : std::uint8_t { Play, Stop, Move, Release, PlayVoice, Forget, PlayStream, StopStream } kind;
+        ALuint source; // The sound's buffer for PlayVoice and Forget
+        ALfloat x, y, z;
+        const std::function<void()> *finished;
+        std::int16_t priority = 0, limit = 0;
+        Stream *stream = nullptr;
+    };
+
 private:
     SoundSystem() = default;
 
     SoundSystem(const SoundSystem&) = delete;
     SoundSystem& operator=(const SoundSystem&) = delete;
+
+    void start();
+    void run();
+
+    // Preallocated sources that Sound::play hands out, touched only by the
+    // audio thread once it runs
+    struct Voice {
+        ALuint source;
+        ALuint buffer = 0; // Playing this, 0 when free
+        int priority = 0;
+        std::uint64_t started = 0;
+    };
+    std::vector<Voice> voices;
+    std::uint64_t voice_clock = 0;
+
+    void playVoice(const Command& command);
+
+    static constexpr std::size_t queue_size = 256;
+    std::array<Command, queue_size> queue;
+    std::atomic<std::size_t> head{0}, tail{0};
+    std::counting_semaphore<> wake{0};
+    std::atomic<bool> stopping{false};
+    std::thread worker;
+
 public:
 
+    // Opens the default device, or falls back to the software mixer
     void init();
+    // Software mixing only, written to a WAV file unless path is empty
+    void initSoftware(const std::string& path);
+
+    // Non-blocking, drops the command when the ring is full
+    bool post(const Command& command);
+    // Waits until the audio thread has handled every posted command
+    void sync();
 
     static SoundSystem& getInstance() {
         static SoundSystem instance;
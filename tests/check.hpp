@@ -0,0 +1,17 @@
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include <iostream>
+
+// Reports a failed condition and goes on, a test's main returns the count
+inline int check_failures = 0;
+
+#define CHECK(x)                                                                      \
+    do {                                                                              \
+        if (not (x)) {                                                                \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #x ") failed" << std::endl; \
+            ++check_failures;                                                         \
+        }                                                                             \
+    } while (0)
+
+#endif // CHECK_HPP
@@ -0,0 +1,89 @@
+#include <cstdint>
+#include <vector>
+
+#include "map.hpp"
+#include "rng.hpp"
+#include "check.hpp"
+
+// The distances kept up by turn(), undo() and redo() against a
+// breadth-first search over the whole board after every move.
+
+static std::vector<int> rebuilt(const Map& map)
+{
+    const int w = int(map.width()), h = int(map.height());
+    std::vector<int> distance(std::size_t(w) * std::size_t(h), Map::unreachable);
+    std::vector<Position> queue;
+
+    for (int i = 0; i < h; ++i)
+        for (int j = 0; j < w; ++j)
+            if ((i == 0 or j == 0 or i == h - 1 or j == w - 1) and map.type({i, j}) != HexType::wall) {
+                distance[i * w + j] = 0;
+                queue.push_back({i, j});
+            }
+
+    for (std::size_t head = 0; head < queue.size(); ++head) {
+        const Position p = queue[head];
+        const Position neighbors_positions[6] = {
+            {p.i+1, p.j - (p.i&1)}, {p.i+1, p.j+1 - (p.i&1)},
+            {p.i, p.j-1}, {p.i, p.j+1},
+            {p.i-1, p.j - (p.i&1)}, {p.i-1, p.j+1 - (p.i&1)}
+        };
+        for (auto &n : neighbors_positions)
+            if (map.within(n) and map.type(n) != HexType::wall and distance[n.i * w + n.j] == Map::unreachable) {
+                distance[n.i * w + n.j] = distance[p.i * w + p.j] + 1;
+                queue.push_back(n);
+            }
+    }
+    return distance;
+}
+
+static bool agrees(const Map& map)
+{
+    const std::vector<int> expected = rebuilt(map);
+    const int w = int(map.width());
+    for (int i = 0; i < int(map.height()); ++i)
+        for (int j = 0; j < w; ++j)
+            if (map.distance({i, j}) != expected[i * w + j])
+                return false;
+    return true;
+}
+
+// Random walls with an undo and redo now and then, then undone back to the fresh board
+static void play(std::uint64_t seed, const MapSettings& settings, int walls)
+{
+    Map map(seed, settings);
+    Rng random(seed ^ 0x5851f42d4c957f2dull); // Walls apart from the generator's draws
+    CHECK(agrees(map));
+
+    for (int n = 0; n < walls and map.status() == Status::playing; ++n) {
+        const Position p = {int(random.below(std::uint32_t(map.height()))), int(random.below(std::uint32_t(map.width())))};
+        if (not map.setWall(p))
+            continue;
+        CHECK(agrees(map));
+
+        if (random.below(4) == 0) {
+            CHECK(map.undo());
+            CHECK(agrees(map));
+            CHECK(map.redo());
+            CHECK(agrees(map));
+        }
+    }
+
+    while (map.undo())
+        CHECK(agrees(map));
+    CHECK(map.ply() == 0);
+}
+
+int main()
+{
+    for (std::uint64_t seed = 1; seed <= 50; ++seed) {
+        play(seed, MapSettings(), 100);
+        play(seed, MapSettings{7, 7, 0.2f}, 100);
+        play(seed, MapSettings{16, 11, 0.3f}, 200);
+    }
+
+    // Wide enough for the plain breadth-first rebuild instead of the bit layers
+    play(1, MapSettings{400, 400, 0.1f}, 30);
+
+    return check_failures;
+}
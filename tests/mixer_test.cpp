@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "mixer.hpp"
+#include "rng.hpp"
+#include "check.hpp"
+
+// The vector kernels of mixAccumulate and floatToPcm16 against plain
+// loops, on every length around their block sizes and at every alignment.
+// Built once as the core library has them, and once more with AVX.
+
+#define MAX_COUNT 80
+#define MAX_SHIFT 8
+
+// Uniform in [low, high)
+static float uniform(Rng& random, float low, float high)
+{
+    return low + (high - low) * float(random.below(1u << 24)) / float(1u << 24);
+}
+
+static void testMixAccumulate(Rng& random)
+{
+    std::vector<float> in(MAX_COUNT + MAX_SHIFT), out(MAX_COUNT + MAX_SHIFT), expected(MAX_COUNT + MAX_SHIFT);
+
+    for (std::size_t count = 0; count <= MAX_COUNT; ++count)
+        for (std::size_t shift = 0; shift < MAX_SHIFT; ++shift) {
+            const float gain = uniform(random, 0.0f, 2.0f);
+            for (std::size_t k = 0; k < in.size(); ++k) {
+                in[k] = uniform(random, -1.0f, 1.0f);
+                out[k] = expected[k] = uniform(random, -1.0f, 1.0f);
+            }
+            for (std::size_t k = shift; k < shift + count; ++k)
+                expected[k] += gain * in[k];
+
+            mixAccumulate(out.data() + shift, in.data() + shift, gain, count);
+
+            // Nothing outside the range is written
+            bool same = true;
+            for (std::size_t k = 0; k < out.size(); ++k)
+                same = same and std::fabs(out[k] - expected[k]) <= 1e-6f;
+            CHECK(same);
+        }
+}
+
+static void testFloatToPcm16(Rng& random)
+{
+    std::vector<float> in(MAX_COUNT + MAX_SHIFT);
+    std::vector<std::int16_t> out(MAX_COUNT + MAX_SHIFT), expected(MAX_COUNT + MAX_SHIFT);
+
+    // Past full scale both ways, and exactly on it
+    const float edges[] = {-2.0f, -1.0f, -0.5f, 0.0f, 0.5f, 1.0f, 2.0f, 1.5f / 32767.0f, -2.5f / 32767.0f};
+
+    for (std::size_t count = 0; count <= MAX_COUNT; ++count)
+        for (std::size_t shift = 0; shift < MAX_SHIFT; ++shift) {
+            for (std::size_t k = 0; k < in.size(); ++k) {
+                in[k] = random.below(4) ? uniform(random, -1.5f, 1.5f) : edges[random.below(std::size(edges))];
+                out[k] = expected[k] = std::int16_t(random.below(1u << 16));
+            }
+            for (std::size_t k = shift; k < shift + count; ++k)
+                expected[k] = std::int16_t(std::lrint(std::clamp(in[k], -1.0f, 1.0f) * 32767.0f));
+
+            floatToPcm16(in.data() + shift, out.data() + shift, count);
+            CHECK(out == expected);
+        }
+}
+
+int main()
+{
+#if defined(MIXER_TEST_AVX)
+    if (not __builtin_cpu_supports("avx"))
+        return 77; // Skipped
+#endif
+
+    Rng random(1);
+    testMixAccumulate(random);
+    testFloatToPcm16(random);
+    return check_failures;
+}
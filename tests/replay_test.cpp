@@ -0,0 +1,125 @@
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "map.hpp"
+#include "replay.hpp"
+#include "rng.hpp"
+#include "check.hpp"
+
+// A recorded session read back token for token, and played back onto the
+// same boards as the games it was recorded from.
+
+struct Game {
+    MapSettings settings;
+    std::uint64_t seed;
+    std::vector<std::uint64_t> tokens; // After the board token
+    Map end;                           // As the game was left
+};
+
+static Game play(std::uint64_t seed, const MapSettings& settings, replay::Writer& writer)
+{
+    Game game = {settings, seed, {}, Map(seed, settings)};
+    Map& map = game.end;
+    Rng random(seed ^ 0x5851f42d4c957f2dull);
+    writer.board(map);
+
+    while (map.status() == Status::playing) {
+        const std::uint32_t roll = random.below(8);
+        if (roll == 0 and map.undo()) {
+            writer.undo();
+            game.tokens.push_back(replay::Token::undo);
+        } else if (roll == 1 and map.redo()) {
+            writer.redo();
+            game.tokens.push_back(replay::Token::redo);
+        } else {
+            const int tile = int(random.below(std::uint32_t(map.width() * map.height())));
+            if (map.setWall({tile / int(map.width()), tile % int(map.width())})) {
+                writer.wall(tile);
+                game.tokens.push_back(replay::Token::first_wall + std::uint64_t(tile));
+            }
+        }
+    }
+    return game;
+}
+
+static bool sameBoard(const Map& a, const Map& b)
+{
+    if (a.width() != b.width() or a.height() != b.height() or a.status() != b.status())
+        return false;
+    for (int i = 0; i < int(a.height()); ++i)
+        for (int j = 0; j < int(a.width()); ++j)
+            if (a.type({i, j}) != b.type({i, j}))
+                return false;
+    return true;
+}
+
+int main()
+{
+    const std::string path = (std::filesystem::temp_directory_path() / "catchthecat_replay_test.ctcr").string();
+
+    // Boards past 125 tiles take two-byte walls
+    std::vector<Game> games;
+    {
+        replay::Writer writer;
+        CHECK(writer.open(path));
+        for (std::uint64_t seed = 1; seed <= 20; ++seed) {
+            games.push_back(play(seed, MapSettings(), writer));
+            games.push_back(play(seed, MapSettings{20, 15, 0.25f, 3}, writer));
+        }
+    }
+
+    {
+        replay::Reader reader(path);
+        replay::Reader::Board board;
+        std::uint64_t token;
+        Map map;
+        std::size_t game = 0, next = 0;
+        bool started = false;
+
+        auto finish = [&]() {
+            CHECK(next == games[game].tokens.size());
+            CHECK(sameBoard(map, games[game].end));
+            ++game;
+        };
+
+        while (reader.next(token, board)) {
+            if (token == replay::Token::board) {
+                if (started)
+                    finish();
+                CHECK(game < games.size());
+                if (game >= games.size())
+                    break;
+
+                const MapSettings& settings = games[game].settings;
+                CHECK(board.seed == games[game].seed);
+                CHECK(board.settings.width == settings.width and board.settings.height == settings.height);
+                CHECK(board.settings.wall_density == settings.wall_density);
+                CHECK(board.settings.min_escape_distance == settings.min_escape_distance);
+
+                map.generate(board.seed, board.settings);
+                started = true;
+                next = 0;
+                continue;
+            }
+
+            CHECK(next < games[game].tokens.size() and token == games[game].tokens[next]);
+            ++next;
+
+            if (token == replay::Token::undo)
+                CHECK(map.undo());
+            else if (token == replay::Token::redo)
+                CHECK(map.redo());
+            else {
+                const int tile = int(token - replay::Token::first_wall);
+                CHECK(map.setWall({tile / int(map.width()), tile % int(map.width())}));
+            }
+        }
+        if (started)
+            finish();
+        CHECK(game == games.size());
+    }
+
+    std::filesystem::remove(path);
+    return check_failures;
+}
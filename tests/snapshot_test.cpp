@@ -0,0 +1,64 @@
+#include <cstdint>
+#include <filesystem>
+
+#include "map.hpp"
+#include "rng.hpp"
+#include "check.hpp"
+
+// A saved board loads back tile for tile, and plays on from there exactly
+// as the board it was saved from.
+
+static bool same(const Map& a, const Map& b)
+{
+    if (a.width() != b.width() or a.height() != b.height() or a.status() != b.status() or
+        a.cat().i != b.cat().i or a.cat().j != b.cat().j)
+        return false;
+    for (int i = 0; i < int(a.height()); ++i)
+        for (int j = 0; j < int(a.width()); ++j)
+            if (a.type({i, j}) != b.type({i, j}) or a.options({i, j}) != b.options({i, j}) or
+                a.distance({i, j}) != b.distance({i, j}) or a.board().wall(i, j) != b.board().wall(i, j) or
+                a.board().final(i, j) != b.board().final(i, j))
+                return false;
+    return true;
+}
+
+static void roundTrip(std::uint64_t seed, const MapSettings& settings, const std::string& path)
+{
+    Map map(seed, settings);
+    Rng random(seed ^ 0x5851f42d4c957f2dull); // Not the stream the board was drawn from
+
+    // Saved partway through a game
+    for (int n = 0; n < 5 and map.status() == Status::playing; ++n)
+        map.setWall({int(random.below(std::uint32_t(map.height()))), int(random.below(std::uint32_t(map.width())))});
+
+    map.save(path);
+    Map loaded;
+    loaded.load(path);
+    CHECK(same(map, loaded));
+    CHECK(loaded.settings().width == settings.width and loaded.settings().height == settings.height);
+    CHECK(loaded.seed() == seed);
+
+    // The journal isn't saved
+    CHECK(loaded.ply() == 0);
+    CHECK(not loaded.undo());
+
+    while (map.status() == Status::playing) {
+        const Position p = {int(random.below(std::uint32_t(map.height()))), int(random.below(std::uint32_t(map.width())))};
+        CHECK(map.setWall(p) == loaded.setWall(p));
+        CHECK(same(map, loaded));
+    }
+}
+
+int main()
+{
+    const std::string path = (std::filesystem::temp_directory_path() / "catchthecat_snapshot_test.ctcs").string();
+
+    for (std::uint64_t seed = 1; seed <= 20; ++seed) {
+        roundTrip(seed, MapSettings(), path);
+        roundTrip(seed, MapSettings{13, 9, 0.2f}, path);
+    }
+    roundTrip(1, MapSettings{400, 400, 0.1f}, path);
+
+    std::filesystem::remove(path);
+    return check_failures;
+}
@@ -0,0 +1,77 @@
+#include <cstdint>
+#include <stdexcept>
+
+#include "map.hpp"
+#include "solver.hpp"
+#include "check.hpp"
+
+// The solver's fewest walls to enclose the cat against trying every wall
+// on every free tile, up to three walls deep.
+
+#define MAX_DEPTH 3
+
+static bool winsWithin(const Map& map, int depth)
+{
+    for (int i = 0; i < int(map.height()); ++i)
+        for (int j = 0; j < int(map.width()); ++j) {
+            Map next = map;
+            if (not next.setWall({i, j}))
+                continue;
+            if (next.status() == Status::win)
+                return true;
+            if (next.status() == Status::playing and depth > 1 and winsWithin(next, depth - 1))
+                return true;
+        }
+    return false;
+}
+
+// Fewest walls of a win, 0 when there is none within `depth`
+static int bruteForce(const Map& map, int depth)
+{
+    for (int d = 1; d <= depth; ++d)
+        if (winsWithin(map, d))
+            return d;
+    return 0;
+}
+
+int main()
+{
+    Solver solver(2, 16);
+    int wins = 0, others = 0;
+
+    for (std::uint64_t seed = 1; seed <= 150; ++seed) {
+        const MapSettings settings = seed % 2 ? MapSettings{5, 5, 0.45f} : MapSettings{6, 6, 0.5f};
+        Map map;
+        try {
+            map.generate(seed, settings);
+        } catch (std::runtime_error&) {
+            continue; // Too dense for a playable board
+        }
+
+        const int expected = bruteForce(map, MAX_DEPTH);
+        const Solver::Result result = solver.solve(map, MAX_DEPTH);
+
+        if (expected) {
+            ++wins;
+            CHECK(result.outcome == Solver::Outcome::win);
+            CHECK(result.moves == expected);
+
+            // The first wall leaves a win one wall shorter
+            Map next = map;
+            CHECK(next.setWall(result.wall));
+            if (expected == 1)
+                CHECK(next.status() == Status::win);
+            else
+                CHECK(bruteForce(next, expected - 1) == expected - 1);
+        } else {
+            ++others;
+            CHECK(result.outcome != Solver::Outcome::win);
+        }
+    }
+
+    // Both kinds of board came up
+    CHECK(wins > 0);
+    CHECK(others > 0);
+
+    return check_failures;
+}
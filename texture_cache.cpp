@@ -0,0 +1,216 @@
+#include <GL/glew.h>
+#include <SOIL/SOIL.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "mapped_file.hpp"
+#include "profiler.hpp"
+#include "texture_cache.hpp"
+
+#define TEXTURE_CACHE_MAGIC "CTCT"
+#define TEXTURE_CACHE_VERSION 1
+
+// Cache layout: this header, then for each level a TextureLevel and its bytes
+struct TextureHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t image_size;  // Of the image the cache was made from
+    std::int64_t image_mtime;
+    std::uint32_t format;      // GL internal format
+    std::uint32_t compressed;
+    std::uint32_t levels;
+    std::uint32_t reserved;
+};
+
+struct TextureLevel {
+    std::uint32_t width, height;
+    std::uint32_t bytes;
+    std::uint32_t reserved;
+};
+
+static std::string cachePath(const std::string& image)
+{
+    return image + ".cache";
+}
+
+static bool imageStamp(const std::string& image, std::uint64_t& size, std::int64_t& mtime)
+{
+    struct stat st;
+    if (::stat(image.c_str(), &st) < 0)
+        return false;
+
+    size = std::uint64_t(st.st_size);
+    mtime = std::int64_t(st.st_mtime);
+    return true;
+}
+
+// The cache's levels, when it was made from this very image
+static bool readCache(const std::string& image, TextureSource& source)
+{
+    std::uint64_t size;
+    std::int64_t mtime;
+    if (not imageStamp(image, size, mtime))
+        return false;
+
+    try {
+        auto file = std::make_unique<MappedFile>(cachePath(image));
+        const unsigned char *data = file->data();
+        const unsigned char *end = data + file->size();
+
+        TextureHeader header;
+        if (file->size() < sizeof(header))
+            return false;
+        std::memcpy(&header, data, sizeof(header));
+        data += sizeof(header);
+
+        if (std::memcmp(header.magic, TEXTURE_CACHE_MAGIC, 4) != 0 or header.version != TEXTURE_CACHE_VERSION or
+            header.image_size != size or header.image_mtime != mtime or header.levels == 0)
+            return false;
+
+        for (std::uint32_t k = 0; k < header.levels; ++k) {
+            TextureLevel level;
+            if (std::size_t(end - data) < sizeof(level))
+                return false;
+            std::memcpy(&level, data, sizeof(level));
+            data += sizeof(level);
+
+            if (std::size_t(end - data) < level.bytes)
+                return false;
+            source.levels.push_back(TextureSource::Level{level.width, level.height, std::size_t(data - file->data()), level.bytes});
+            data += level.bytes;
+        }
+
+        source.cache = std::move(file);
+        source.format = header.format;
+        source.compressed = header.compressed;
+    } catch (std::runtime_error&) {
+        source = TextureSource();
+        return false;
+    }
+    return true;
+}
+
+TextureSource readTexture(const std::string& image)
+{
+    profiler::Scope scope("readTexture");
+
+    TextureSource source;
+    if (readCache(image, source))
+        return source;
+    source = TextureSource();
+
+    unsigned char *pixels = SOIL_load_image(image.c_str(), &source.width, &source.height, 0, SOIL_LOAD_RGB);
+    if (pixels) {
+        source.data.assign(pixels, pixels + std::size_t(source.width) * std::size_t(source.height) * 3);
+        SOIL_free_image_data(pixels);
+    }
+    return source;
+}
+
+static bool saveTextureCache(const std::string& image);
+
+void uploadTexture(const std::string& image, const TextureSource& source)
+{
+    profiler::Scope scope("uploadTexture");
+
+    // Decoding and mipmapping happen once, later launches upload the cache
+    if (not source.levels.empty()) {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (std::size_t k = 0; k < source.levels.size(); ++k) {
+            const TextureSource::Level &level = source.levels[k];
+            const unsigned char *bytes = source.cache->data() + level.offset;
+            if (source.compressed)
+                glCompressedTexImage2D(GL_TEXTURE_2D, GLint(k), source.format, level.width, level.height, 0,
+                                       GLsizei(level.bytes), bytes);
+            else
+                glTexImage2D(GL_TEXTURE_2D, GLint(k), source.format, level.width, level.height, 0,
+                             GL_RGB, GL_UNSIGNED_BYTE, bytes);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(source.levels.size()) - 1);
+        return;
+    }
+
+    if (source.data.empty()) {
+        std::cerr << "ERROR: can't load " << image << std::endl;
+        return;
+    }
+
+    // The driver block-compresses the levels when it can
+    const GLenum format = GLEW_EXT_texture_compression_s3tc ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_RGB;
+    glTexImage2D(GL_TEXTURE_2D, 0, format, source.width, source.height, 0, GL_RGB, GL_UNSIGNED_BYTE, source.data.data());
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    if (not saveTextureCache(image))
+        std::cerr << "WARNING: can't cache " << image << std::endl;
+}
+
+// Reads all levels back from the bound texture into the cache
+static bool saveTextureCache(const std::string& image)
+{
+    profiler::Scope scope("saveTextureCache");
+
+    TextureHeader header = {};
+    std::memcpy(header.magic, TEXTURE_CACHE_MAGIC, 4);
+    header.version = TEXTURE_CACHE_VERSION;
+    if (not imageStamp(image, header.image_size, header.image_mtime))
+        return false;
+
+    GLint format = 0, compressed = 0, width = 0, height = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    if (width <= 0 or height <= 0)
+        return false;
+
+    // Down to 1x1, as glGenerateMipmap made them
+    std::uint32_t levels = 1;
+    for (GLint side = std::max(width, height); side > 1; side /= 2)
+        ++levels;
+
+    header.format = std::uint32_t(format);
+    header.compressed = std::uint32_t(compressed);
+    header.levels = levels;
+
+    std::ofstream out(cachePath(image), std::ios::binary | std::ios::trunc);
+    if (not out)
+        return false;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    std::vector<unsigned char> bytes;
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (std::uint32_t k = 0; k < levels; ++k) {
+        TextureLevel level = {};
+        GLint w = 0, h = 0, size = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, GLint(k), GL_TEXTURE_WIDTH, &w);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, GLint(k), GL_TEXTURE_HEIGHT, &h);
+        level.width = std::uint32_t(w);
+        level.height = std::uint32_t(h);
+
+        if (compressed) {
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, GLint(k), GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            bytes.resize(std::size_t(size));
+            glGetCompressedTexImage(GL_TEXTURE_2D, GLint(k), bytes.data());
+        } else {
+            bytes.resize(std::size_t(w) * std::size_t(h) * 3);
+            glGetTexImage(GL_TEXTURE_2D, GLint(k), GL_RGB, GL_UNSIGNED_BYTE, bytes.data());
+        }
+        level.bytes = std::uint32_t(bytes.size());
+
+        out.write(reinterpret_cast<const char *>(&level), sizeof(level));
+        out.write(reinterpret_cast<const char *>(bytes.data()), std::streamsize(bytes.size()));
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    return bool(out.flush());
+}
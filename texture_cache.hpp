@@ -0,0 +1,39 @@
+#ifndef TEXTURE_CACHE_HPP
+#define TEXTURE_CACHE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+// Ready-to-upload copies of decoded images, next to the image as
+// "<image>.cache": every mip level in the texture's internal format,
+// block-compressed when the driver did that on the first upload. A cache
+// older than its image, or of another size, is ignored.
+
+// An image read from disk, to be uploaded on the GL thread
+struct TextureSource {
+    struct Level {
+        std::uint32_t width, height;
+        std::size_t offset, bytes; // Into the cache
+    };
+
+    std::unique_ptr<MappedFile> cache; // Levels are uploaded straight from it
+    std::vector<Level> levels;         // Empty when the image was decoded
+    std::vector<unsigned char> data;   // The decoded RGB image
+    std::uint32_t format = 0;
+    bool compressed = false;
+    int width = 0, height = 0;       // Of the decoded image
+};
+
+// Reads the cache, or decodes the image when there is no usable one; meant
+// for a worker thread
+TextureSource readTexture(const std::string& image);
+
+// Uploads into the texture bound to GL_TEXTURE_2D, and writes the cache
+// after decoding the image
+void uploadTexture(const std::string& image, const TextureSource& source);
+
+#endif // TEXTURE_CACHE_HPP
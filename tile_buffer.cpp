@@ -0,0 +1,150 @@
+#include <cstddef>
+
+#include "tile_buffer.hpp"
+
+// Above this share of the board changed, one copy of the board beats patching tile by tile
+#define TILE_BUFFER_FULL_SHARE 8
+
+TileBuffer::TileBuffer(GLuint vao, GLuint type_location, GLuint options_location)
+    : m_vao(vao), m_type_location(type_location), m_options_location(options_location)
+{
+    glGenBuffers(1, &m_buffer);
+}
+
+TileBuffer::~TileBuffer()
+{
+    release();
+    glDeleteBuffers(1, &m_buffer);
+}
+
+void TileBuffer::release()
+{
+    for (auto &f : m_fences) {
+        if (f)
+            glDeleteSync(f);
+        f = nullptr;
+    }
+
+    if (m_mapped) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        m_mapped = nullptr;
+    }
+}
+
+void TileBuffer::allocate(std::size_t tiles)
+{
+    release();
+
+    // Immutable storage can't be resized, so a new size needs a new buffer
+    glDeleteBuffers(1, &m_buffer);
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+
+    m_tiles = tiles;
+    if (GLEW_ARB_buffer_storage) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        const GLsizeiptr bytes = GLsizeiptr(copies * tiles * sizeof(Record));
+        glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+        m_mapped = static_cast<Record *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags));
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(tiles * sizeof(Record)), nullptr, GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    for (int c = 0; c < copies; ++c) {
+        m_pending[c].clear();
+        m_stale[c] = true;
+    }
+}
+
+void TileBuffer::update(Map& map)
+{
+    const std::size_t tiles = map.width() * map.height();
+    if (tiles != m_tiles)
+        allocate(tiles);
+
+    // Every copy has to catch up with this frame's changes sooner or later
+    const int used = persistent() ? copies : 1;
+    for (int c = 0; c < used; ++c) {
+        if (map.allDirty())
+            m_stale[c] = true;
+        else if (not m_stale[c])
+            m_pending[c].insert(m_pending[c].end(), map.dirtyTiles().begin(), map.dirtyTiles().end());
+
+        if (m_pending[c].size() * TILE_BUFFER_FULL_SHARE > tiles) {
+            m_stale[c] = true;
+            m_pending[c].clear();
+        }
+    }
+    map.clearDirty();
+
+    const HexType *types = map.types();
+    const opt_t *options = map.options();
+    m_uploaded = 0;
+
+    if (persistent()) {
+        m_current = (m_current + 1) % copies;
+
+        // Wait for the GPU to finish the frame that last read this copy
+        if (GLsync &f = m_fences[m_current]) {
+            glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1e9));
+            glDeleteSync(f);
+            f = nullptr;
+        }
+
+        Record *copy = m_mapped + m_current * tiles;
+        if (m_stale[m_current]) {
+            for (std::size_t k = 0; k < tiles; ++k)
+                copy[k] = Record{types[k], options[k]};
+            m_uploaded = tiles * sizeof(Record);
+        } else {
+            for (int k : m_pending[m_current])
+                copy[k] = Record{types[k], options[k]};
+            m_uploaded = m_pending[m_current].size() * sizeof(Record);
+        }
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+        if (m_stale[0]) {
+            std::vector<Record> records(tiles);
+            for (std::size_t k = 0; k < tiles; ++k)
+                records[k] = Record{types[k], options[k]};
+            glBufferSubData(GL_ARRAY_BUFFER, 0, GLsizeiptr(tiles * sizeof(Record)), records.data());
+            m_uploaded = tiles * sizeof(Record);
+        } else {
+            for (int k : m_pending[0]) {
+                const Record record = {types[k], options[k]};
+                glBufferSubData(GL_ARRAY_BUFFER, GLintptr(k * sizeof(Record)), sizeof(Record), &record);
+            }
+            m_uploaded = m_pending[0].size() * sizeof(Record);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    m_stale[m_current] = false;
+    m_pending[m_current].clear();
+    bindAttributes(std::size_t(m_current));
+}
+
+void TileBuffer::fence()
+{
+    if (persistent())
+        m_fences[m_current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void TileBuffer::bindAttributes(std::size_t copy)
+{
+    const std::size_t offset = copy * m_tiles * sizeof(Record);
+
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    glVertexAttribIPointer(m_type_location, 1, GL_UNSIGNED_BYTE, sizeof(Record), (GLvoid *) (offset + offsetof(Record, type)));
+    glVertexAttribDivisor(m_type_location, 1);
+    glEnableVertexAttribArray(m_type_location);
+    glVertexAttribIPointer(m_options_location, 1, GL_UNSIGNED_BYTE, sizeof(Record), (GLvoid *) (offset + offsetof(Record, options)));
+    glVertexAttribDivisor(m_options_location, 1);
+    glEnableVertexAttribArray(m_options_location);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
@@ -0,0 +1,63 @@
+#ifndef TILE_BUFFER_HPP
+#define TILE_BUFFER_HPP
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "map.hpp"
+
+// Per-instance tile records of the board: type and options, two bytes a
+// tile. Only the tiles Map reports dirty are written each frame.
+//
+// With ARB_buffer_storage the buffer holds three copies of the board, mapped
+// once and kept mapped. Frame n writes copy n % 3 behind a fence, so the GPU
+// can still read the other two. Each copy keeps its own list of changes it
+// has missed. Without the extension there is one copy, patched with
+// glBufferSubData.
+class TileBuffer {
+public:
+    // Binds attributes `type_location` and `options_location` of the vertex
+    // array `vao`, one record per instance
+    TileBuffer(GLuint vao, GLuint type_location, GLuint options_location);
+    ~TileBuffer();
+
+    TileBuffer(const TileBuffer&) = delete;
+    TileBuffer& operator=(const TileBuffer&) = delete;
+
+    // Brings the next copy up to date with the map and points the
+    // attributes at it, then clears the map's dirty tiles
+    void update(Map& map);
+
+    // Call after the draw reading the copy of the last update()
+    void fence();
+
+    bool persistent() const { return m_mapped != nullptr; }
+    std::size_t uploadedBytes() const { return m_uploaded; } // By the last update()
+
+private:
+    static constexpr int copies = 3;
+
+    struct Record {
+        HexType type;
+        opt_t options;
+    };
+
+    GLuint m_vao, m_type_location, m_options_location;
+    GLuint m_buffer = 0;
+    std::size_t m_tiles = 0;
+    Record *m_mapped = nullptr;
+
+    int m_current = 0;
+    GLsync m_fences[copies] = {};
+    std::vector<int> m_pending[copies]; // Tiles changed since the copy was written
+    bool m_stale[copies] = {};          // The whole copy needs writing
+
+    std::size_t m_uploaded = 0;
+
+    void allocate(std::size_t tiles);
+    void release();
+    void bindAttributes(std::size_t copy);
+};
+
+#endif // TILE_BUFFER_HPP
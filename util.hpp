@@ -5,6 +5,9 @@
 #define LOG(x) std::cout << #x << ": " << (x) << std::endl;
 
 //#define PATH_HIGHLIGHT
+//#define RECURSIVE_PATHFINDING
+//#define FULL_PATH_SEARCH
 #define KEYBOARD_CONTROL
+//#define UNIFORM_STATS
 
 #endif // UTIL_HPP
@@ -2,12 +2,40 @@
 
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec2 texCoord;
-uniform mat4 model, view, projection;
+
+// Per instance, straight from Map's tile arrays: instance k is tile (k / Width, k % Width)
+layout (location = 2) in uint type;
+layout (location = 3) in uint options;
+
+uniform mat4 view, projection;
+
+// BoardLayout
+uniform int Width;
+uniform float Scale;
+uniform vec2 Offset;
+uniform float StrideX, StrideY, Shift;
+
+uniform float CatAngle; // Flip of the cat's tile around the x axis, in radians
 
 out vec2 TexCoord;
+flat out uint Type;
+flat out uint Options;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f);
+    int i = gl_InstanceID / Width;
+    int j = gl_InstanceID % Width;
+
+    vec3 p = position;
+    if (type == 2u) {
+        float c = cos(CatAngle), s = sin(CatAngle);
+        p = vec3(p.x, p.y * c - p.z * s, p.y * s + p.z * c);
+    }
+
+    vec2 tile = vec2(j * StrideX + Shift * float((i & 1) == 0), i * StrideY);
+    gl_Position = projection * view * vec4(Offset + Scale * (tile + p.xy), Scale * p.z, 1.0f);
+
     TexCoord = texCoord;
+    Type = type;
+    Options = options;
 }